@@ -1,8 +1,52 @@
-#include <map>
 #include <string>
 #include <vector>
 #include <memory>
 #include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <exception>
+#include <array>
+#include <tuple>
+#include <initializer_list>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <memory_resource>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Define SEMANTIC_INSTRUMENT to collect AnalyzerStats. Without it every
+// SEMANTIC_STAT(...) expands to nothing and no stats storage exists.
+#ifdef SEMANTIC_INSTRUMENT
+#include <chrono>
+#define SEMANTIC_STAT(...) __VA_ARGS__
+#else
+#define SEMANTIC_STAT(...)
+#endif
 
 enum class SymbolType {
     Variable,
@@ -11,310 +55,4727 @@ enum class SymbolType {
 };
 
 enum class TypeKind {
-    Int, Float, String, Bool, Auto, Unknown
+    Int, Float, String, Bool, Auto, Void, Unknown
+};
+
+// 32-bit type handle. Primitive types are encoded entirely in the bits;
+// compound types carry an index into a TypeTable. Handles are canonical,
+// so equality is a single integer compare.
+class TypeInfo {
+    // Layout: kind:4 | width class:3 | signed:1 | mutable:1 | table index:23
+    static constexpr uint32_t kKindMask = 0xF;
+    static constexpr uint32_t kWidthShift = 4;
+    static constexpr uint32_t kWidthMask = 0x7u << kWidthShift;
+    static constexpr uint32_t kSignedBit = 1u << 7;
+    static constexpr uint32_t kMutableBit = 1u << 8;
+    static constexpr uint32_t kIndexShift = 9;
+    
+    uint32_t bits;
+    
+    static constexpr uint32_t width_class(int width) {
+        switch (width) {
+            case 8: return 1;
+            case 16: return 2;
+            case 32: return 3;
+            case 64: return 4;
+            case 128: return 5;
+            default: return 0;
+        }
+    }
+    
+    constexpr explicit TypeInfo(uint32_t bits) : bits(bits) {}
+    
+public:
+    static constexpr uint32_t kMaxTableIndex = (1u << (32 - kIndexShift)) - 1;
+    
+    constexpr TypeInfo() : bits(static_cast<uint32_t>(TypeKind::Unknown)) {}
+    
+    // Width and signedness only mean something for numeric kinds and are
+    // dropped for the others, which keeps every handle canonical
+    constexpr TypeInfo(TypeKind kind, int width, bool is_signed, bool is_mutable)
+        : bits(static_cast<uint32_t>(kind) |
+               ((kind == TypeKind::Int || kind == TypeKind::Float)
+                    ? (width_class(width) << kWidthShift) | (is_signed ? kSignedBit : 0)
+                    : 0) |
+               (is_mutable ? kMutableBit : 0)) {}
+    
+    static constexpr TypeInfo from_raw(uint32_t bits) {
+        return TypeInfo(bits);
+    }
+    
+    static constexpr TypeInfo compound(TypeKind kind, uint32_t table_index) {
+        return TypeInfo(static_cast<uint32_t>(kind) | (table_index << kIndexShift));
+    }
+    
+    constexpr TypeKind kind() const {
+        return static_cast<TypeKind>(bits & kKindMask);
+    }
+    
+    constexpr int width() const {
+        constexpr int widths[] = {0, 8, 16, 32, 64, 128, 0, 0};
+        return widths[(bits & kWidthMask) >> kWidthShift];
+    }
+    
+    constexpr bool is_signed() const {
+        return (bits & kSignedBit) != 0;
+    }
+    
+    constexpr bool is_mutable() const {
+        return (bits & kMutableBit) != 0;
+    }
+    
+    constexpr TypeInfo with_mutable(bool is_mutable) const {
+        return TypeInfo(is_mutable ? bits | kMutableBit : bits & ~kMutableBit);
+    }
+    
+    // Zero for primitive types
+    constexpr uint32_t table_index() const {
+        return bits >> kIndexShift;
+    }
+    
+    constexpr uint32_t raw() const {
+        return bits;
+    }
+    
+    // Mutability is a property of the binding, not of the type
+    constexpr bool operator==(const TypeInfo& other) const {
+        return (bits & ~kMutableBit) == (other.bits & ~kMutableBit);
+    }
+    
+    constexpr bool operator!=(const TypeInfo& other) const {
+        return !(*this == other);
+    }
 };
 
-struct TypeInfo {
-    TypeKind kind;
-    int width; // For numeric types (8, 16, 32, etc.)
-    bool is_signed;
-    bool is_mutable;
+static_assert(sizeof(TypeInfo) == 4, "TypeInfo must stay a 32-bit handle");
+
+// Interned descriptors for compound types: a kind plus operand types.
+// Structurally equal types share one entry and therefore one handle.
+class TypeTable {
+    struct Entry {
+        TypeKind kind;
+        uint32_t first_operand;
+        uint32_t operand_count;
+    };
+    
+    std::pmr::vector<Entry> entries; // Index 0 is reserved for primitives
+    std::pmr::vector<TypeInfo> operands;
+    std::pmr::vector<uint32_t> slots; // Open addressing over entry indices, 0 is empty
+    
+    uint64_t hash(TypeKind kind, const TypeInfo* ops, size_t count) const {
+        uint64_t h = static_cast<uint64_t>(kind) * 0x9E3779B97F4A7C15ull;
+        for (size_t i = 0; i < count; ++i) {
+            h = (h ^ ops[i].raw()) * 0x100000001B3ull;
+        }
+        return h ^ (h >> 29);
+    }
+    
+    bool matches(const Entry& e, TypeKind kind, const TypeInfo* ops, size_t count) const {
+        if (e.kind != kind || e.operand_count != count) return false;
+        for (size_t i = 0; i < count; ++i) {
+            if (operands[e.first_operand + i].raw() != ops[i].raw()) return false;
+        }
+        return true;
+    }
+    
+    void grow() {
+        std::pmr::vector<uint32_t> old = std::move(slots);
+        slots.assign(old.empty() ? 16 : old.size() * 2, 0);
+        for (uint32_t index : old) {
+            if (index == 0) continue;
+            const Entry& e = entries[index];
+            size_t i = hash(e.kind, &operands[e.first_operand], e.operand_count) & (slots.size() - 1);
+            while (slots[i] != 0) i = (i + 1) & (slots.size() - 1);
+            slots[i] = index;
+        }
+    }
+    
+public:
+    explicit TypeTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : entries(1, Entry{TypeKind::Unknown, 0, 0}, resource), operands(resource), slots(resource) {}
     
-    bool operator==(const TypeInfo& other) const {
-        return kind == other.kind && 
-               width == other.width && 
-               is_signed == other.is_signed;
+    TypeInfo intern(TypeKind kind, std::initializer_list<TypeInfo> ops) {
+        if (entries.size() * 2 > slots.size()) grow();
+        
+        size_t mask = slots.size() - 1;
+        size_t i = hash(kind, ops.begin(), ops.size()) & mask;
+        while (slots[i] != 0) {
+            if (matches(entries[slots[i]], kind, ops.begin(), ops.size())) {
+                return TypeInfo::compound(kind, slots[i]);
+            }
+            i = (i + 1) & mask;
+        }
+        
+        if (entries.size() > TypeInfo::kMaxTableIndex) {
+            throw std::length_error("Type table is full");
+        }
+        uint32_t index = static_cast<uint32_t>(entries.size());
+        entries.push_back(Entry{kind, static_cast<uint32_t>(operands.size()), static_cast<uint32_t>(ops.size())});
+        operands.insert(operands.end(), ops.begin(), ops.end());
+        slots[i] = index;
+        return TypeInfo::compound(kind, index);
+    }
+    
+    size_t operand_count(TypeInfo type) const {
+        return entries[type.table_index()].operand_count;
+    }
+    
+    TypeInfo operand(TypeInfo type, size_t i) const {
+        return operands[entries[type.table_index()].first_operand + i];
+    }
+    
+    size_t size() const {
+        return entries.size() - 1;
+    }
+};
+
+// Built-in type names, resolved through a perfect hash computed at compile
+// time: one hash and one string compare per annotation, no allocation.
+struct TypeName {
+    std::string_view name;
+    TypeInfo type;
+};
+
+constexpr TypeName kTypeNames[] = {
+    {"i8", {TypeKind::Int, 8, true, false}},
+    {"u8", {TypeKind::Int, 8, false, false}},
+    {"i16", {TypeKind::Int, 16, true, false}},
+    {"u16", {TypeKind::Int, 16, false, false}},
+    {"i32", {TypeKind::Int, 32, true, false}},
+    {"u32", {TypeKind::Int, 32, false, false}},
+    {"i64", {TypeKind::Int, 64, true, false}},
+    {"u64", {TypeKind::Int, 64, false, false}},
+    {"i128", {TypeKind::Int, 128, true, false}},
+    {"u128", {TypeKind::Int, 128, false, false}},
+    {"f32", {TypeKind::Float, 32, true, false}},
+    {"f64", {TypeKind::Float, 64, true, false}},
+    {"str", {TypeKind::String, 0, false, false}},
+    {"string", {TypeKind::String, 0, false, false}},
+    {"bool", {TypeKind::Bool, 0, false, false}},
+    {"auto", {TypeKind::Auto, 0, false, false}},
+    {"void", {TypeKind::Void, 0, false, false}},
+};
+
+constexpr size_t kTypeNameCount = sizeof(kTypeNames) / sizeof(kTypeNames[0]);
+constexpr size_t kTypeNameSlots = 32; // Power of two above kTypeNameCount
+
+// Length plus first, second and last character tell every built-in apart
+constexpr size_t type_name_slot(std::string_view name, uint32_t seed) {
+    uint32_t h = seed ^ static_cast<uint32_t>(name.size());
+    h = (h ^ static_cast<unsigned char>(name[0])) * 0x01000193u;
+    h = (h ^ static_cast<unsigned char>(name[name.size() > 1 ? 1 : 0])) * 0x01000193u;
+    h = (h ^ static_cast<unsigned char>(name[name.size() - 1])) * 0x01000193u;
+    return (h ^ (h >> 16)) & (kTypeNameSlots - 1);
+}
+
+constexpr uint32_t find_type_name_seed() {
+    for (uint32_t seed = 0; seed < 1u << 16; ++seed) {
+        bool used[kTypeNameSlots] = {};
+        bool collision = false;
+        for (const auto& t : kTypeNames) {
+            size_t slot = type_name_slot(t.name, seed);
+            if (used[slot]) {
+                collision = true;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (!collision) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t kTypeNameSeed = find_type_name_seed();
+static_assert(kTypeNameSeed != UINT32_MAX, "no collision-free seed for the built-in type names");
+
+// Slot -> index into kTypeNames plus one, zero for an empty slot
+constexpr std::array<uint8_t, kTypeNameSlots> make_type_name_slots() {
+    std::array<uint8_t, kTypeNameSlots> slots{};
+    for (size_t i = 0; i < kTypeNameCount; ++i) {
+        slots[type_name_slot(kTypeNames[i].name, kTypeNameSeed)] = static_cast<uint8_t>(i + 1);
     }
+    return slots;
+}
+
+constexpr std::array<uint8_t, kTypeNameSlots> kTypeNameTable = make_type_name_slots();
+
+// Returns nullopt for names that aren't built-in types
+constexpr std::optional<TypeInfo> lookup_type_name(std::string_view name) {
+    if (name.empty()) return std::nullopt;
+    uint8_t entry = kTypeNameTable[type_name_slot(name, kTypeNameSeed)];
+    if (entry == 0 || kTypeNames[entry - 1].name != name) return std::nullopt;
+    return kTypeNames[entry - 1].type;
+}
+
+static_assert(lookup_type_name("u128")->width() == 128, "type name table is broken");
+static_assert(!lookup_type_name("i31"), "type name table is broken");
+
+// Symbols outside any function body have no dataflow slot
+constexpr uint32_t kNoSlot = UINT32_MAX;
+
+// Compile-time value of a folded constant. Integers are kept sign- or
+// zero-extended to 64 bits according to their type.
+struct ConstantValue {
+    enum Kind : uint8_t { None, Int, Float, Bool };
+    
+    Kind kind = None;
+    union {
+        int64_t integer = 0;
+        double real;
+        bool boolean;
+    };
 };
 
 struct Symbol {
-    std::string name;
+    std::string_view name; // Interned, so it outlives the AST node it came from
     SymbolType symbol_type;
     TypeInfo type_info;
     bool is_initialized;
     int declaration_line;
+    
+    // Functions only; the array lives in the declaring analyzer's arena
+    const TypeInfo* param_types = nullptr;
+    uint32_t param_count = 0;
+    
+    // Dense index among the locals of the enclosing function bodies, for
+    // the initialization and use bitsets
+    uint32_t slot = kNoSlot;
+    
+    // Constants only, when the initializer could be evaluated
+    ConstantValue value;
+    
+    Symbol() = default;
+    
+    Symbol(std::string_view name, SymbolType symbol_type, TypeInfo type_info, bool is_initialized,
+           int declaration_line, const TypeInfo* param_types = nullptr, uint32_t param_count = 0)
+        : name(name), symbol_type(symbol_type), type_info(type_info), is_initialized(is_initialized),
+          declaration_line(declaration_line), param_types(param_types), param_count(param_count) {}
 };
 
-class SemanticError : public std::runtime_error {
+static_assert(std::is_trivially_destructible<Symbol>::value,
+              "Symbols are bump-allocated and never destroyed individually");
+
+// Bump allocator that carves objects out of large blocks. Nothing is freed
+// individually; reset() releases a whole translation unit at once. Blocks
+// come from the given memory resource.
+class Arena {
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+    
+    // Destructors of non-trivial objects, run in reverse order on reset()
+    struct Cleanup {
+        void (*destroy)(void*);
+        void* object;
+        Cleanup* next;
+    };
+    
+    Block* blocks = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    Cleanup* cleanups = nullptr;
+    size_t block_size;
+    std::pmr::memory_resource* resource;
+    
+    void add_block(size_t min_bytes) {
+        size_t size = min_bytes + sizeof(Block) > block_size ? min_bytes + sizeof(Block) : block_size;
+        Block* block = static_cast<Block*>(resource->allocate(size, alignof(std::max_align_t)));
+        block->next = blocks;
+        block->size = size;
+        blocks = block;
+        cursor = reinterpret_cast<char*>(block + 1);
+        limit = reinterpret_cast<char*>(block) + size;
+    }
+    
+    void free_block(Block* block) {
+        resource->deallocate(block, block->size, alignof(std::max_align_t));
+    }
+    
+    void run_cleanups() {
+        while (cleanups) {
+            Cleanup* c = cleanups;
+            cleanups = c->next;
+            c->destroy(c->object);
+        }
+    }
+    
 public:
-    int line;
-    SemanticError(const std::string& msg, int line) 
-        : std::runtime_error(msg), line(line) {}
+    explicit Arena(size_t block_size = 64 * 1024,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : block_size(block_size), resource(resource) {}
+    
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    ~Arena() {
+        run_cleanups();
+        while (blocks) {
+            Block* next = blocks->next;
+            free_block(blocks);
+            blocks = next;
+        }
+    }
+    
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t(align) - 1);
+        if (!cursor || p + bytes > reinterpret_cast<uintptr_t>(limit)) {
+            add_block(bytes + align);
+            p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t(align) - 1);
+        }
+        cursor = reinterpret_cast<char*>(p + bytes);
+        return reinterpret_cast<void*>(p);
+    }
+    
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        T* obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            Cleanup* c = static_cast<Cleanup*>(allocate(sizeof(Cleanup), alignof(Cleanup)));
+            c->destroy = [](void* o) { static_cast<T*>(o)->~T(); };
+            c->object = obj;
+            c->next = cleanups;
+            cleanups = c;
+        }
+        return obj;
+    }
+    
+    struct Mark {
+        Block* block;
+        char* cursor;
+        Cleanup* cleanups;
+    };
+    
+    Mark mark() const {
+        return Mark{blocks, cursor, cleanups};
+    }
+    
+    // Destroys everything allocated since m was taken and frees the blocks
+    // added after it
+    void rewind(const Mark& m) {
+        while (cleanups != m.cleanups) {
+            Cleanup* c = cleanups;
+            cleanups = c->next;
+            c->destroy(c->object);
+        }
+        while (blocks != m.block) {
+            Block* next = blocks->next;
+            free_block(blocks);
+            blocks = next;
+        }
+        cursor = m.cursor;
+        limit = blocks ? reinterpret_cast<char*>(blocks) + blocks->size : nullptr;
+    }
+    
+    // Destroys everything allocated so far. The most recent block is kept
+    // so that the next unit starts without touching the global heap.
+    void reset() {
+        run_cleanups();
+        if (!blocks) return;
+        while (blocks->next) {
+            Block* next = blocks->next->next;
+            free_block(blocks->next);
+            blocks->next = next;
+        }
+        cursor = reinterpret_cast<char*>(blocks + 1);
+        limit = reinterpret_cast<char*>(blocks) + blocks->size;
+    }
 };
 
-class SemanticAnalyzer {
-    std::map<std::string, Symbol> symbol_table;
-    std::vector<std::map<std::string, Symbol>> scope_stack;
-    TypeInfo current_return_type;
-    bool in_function = false;
+// Standard allocator adaptor over an Arena, e.g. for std::allocate_shared.
+// Deallocation is a no-op; memory comes back when the arena is reset.
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
     
-public:
-    SemanticAnalyzer() {
+    Arena* arena;
+    
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+    
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    
+    void deallocate(T*, size_t) {}
+    
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
 
-        enter_scope();
+// Dense integer handle for an interned identifier
+using SymbolId = uint32_t;
+constexpr SymbolId kNoSymbol = UINT32_MAX;
+
+// Hashing and equality for identifier bytes. Generated sources are full of
+// long names sharing most of their prefix, so both work on 16- and 32-byte
+// blocks with whatever vector unit the build targets (AVX2, SSE2 or NEON)
+// rather than byte by byte. The hash is the same on every path, since
+// SymbolImage files store slots keyed by it.
+struct NameKernel {
+    static uint64_t hash(std::string_view name) {
+        const char* p = name.data();
+        size_t n = name.size();
+        alignas(32) uint64_t acc[4] = {kSeed[0], kSeed[1], kSeed[2], kSeed[3]};
+        if (n < 32) {
+            char stripe[32] = {};
+            if (n) std::memcpy(stripe, p, n);
+            accumulate(acc, stripe);
+        } else {
+            // The last stripe overlaps the one before unless n is a multiple of 32
+            for (size_t i = 0; i + 32 < n; i += 32) accumulate(acc, p + i);
+            accumulate(acc, p + n - 32);
+        }
+        
+        uint64_t h = n * 0x9E3779B97F4A7C15ull;
+        for (uint64_t a : acc) {
+            h ^= a;
+            h *= 0xBF58476D1CE4E5B9ull;
+            h ^= h >> 31;
+        }
+        // fmix64, so the low bits used as a slot index depend on every byte
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+    
+    static bool equal(std::string_view a, std::string_view b) {
+        size_t n = a.size();
+        if (n != b.size()) return false;
+        const char* p = a.data();
+        const char* q = b.data();
+        if (n < 16) {
+            if (n < 8) return n == 0 || std::memcmp(p, q, n) == 0;
+            return load64(p) == load64(q) && load64(p + n - 8) == load64(q + n - 8);
+        }
         
+        // Names that share a long prefix differ near the end, so the
+        // (possibly overlapping) last block is compared first
+#ifdef __AVX2__
+        if (n >= 32) {
+            if (!same32(p + n - 32, q + n - 32)) return false;
+            for (size_t i = 0; i + 32 < n; i += 32) {
+                if (!same32(p + i, q + i)) return false;
+            }
+            return true;
+        }
+#endif
+        if (!same16(p + n - 16, q + n - 16)) return false;
+        for (size_t i = 0; i + 16 < n; i += 16) {
+            if (!same16(p + i, q + i)) return false;
+        }
+        return true;
+    }
+    
+private:
+    static constexpr uint64_t kSeed[4] = {
+        0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull
+    };
+    alignas(32) static constexpr uint64_t kSecret[4] = {
+        0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull, 0x3F84D5B5B5470917ull
+    };
+    
+    static uint64_t load64(const char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof v);
+        return v;
+    }
+    
+    // One 32-byte stripe, four 64-bit lanes: each lane adds the product of
+    // the two halves of (data ^ secret) and the neighbouring lane's data,
+    // so no input bit is lost when a half multiplies to zero
+    static void accumulate(uint64_t* acc, const char* p) {
+#if defined(__AVX2__)
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i k = _mm256_xor_si256(d, _mm256_load_si256(reinterpret_cast<const __m256i*>(kSecret)));
+        __m256i product = _mm256_mul_epu32(k, _mm256_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i* a = reinterpret_cast<__m256i*>(acc);
+        _mm256_store_si256(a, _mm256_add_epi64(_mm256_load_si256(a), _mm256_add_epi64(product, swapped)));
+#elif defined(__SSE2__)
+        for (size_t half = 0; half < 2; ++half) {
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * half));
+            __m128i k = _mm_xor_si128(d, _mm_load_si128(reinterpret_cast<const __m128i*>(kSecret + 2 * half)));
+            __m128i product = _mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            __m128i* a = reinterpret_cast<__m128i*>(acc + 2 * half);
+            _mm_store_si128(a, _mm_add_epi64(_mm_load_si128(a), _mm_add_epi64(product, swapped)));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        for (size_t half = 0; half < 2; ++half) {
+            uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p + 16 * half)));
+            uint64x2_t k = veorq_u64(d, vld1q_u64(kSecret + 2 * half));
+            uint64x2_t product = vmull_u32(vmovn_u64(k), vshrn_n_u64(k, 32));
+            uint64x2_t swapped = vextq_u64(d, d, 1);
+            vst1q_u64(acc + 2 * half, vaddq_u64(vld1q_u64(acc + 2 * half), vaddq_u64(product, swapped)));
+        }
+#else
+        uint64_t d[4];
+        std::memcpy(d, p, sizeof d);
+        for (size_t i = 0; i < 4; ++i) {
+            uint64_t k = d[i] ^ kSecret[i];
+            acc[i] += (k & 0xFFFFFFFFu) * (k >> 32) + d[i ^ 1];
+        }
+#endif
+    }
+    
+    static bool same16(const char* p, const char* q) {
+#if defined(__SSE2__)
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t y = vld1q_u8(reinterpret_cast<const uint8_t*>(q));
+        return vminvq_u8(vceqq_u8(x, y)) == 0xFF;
+#else
+        return ((load64(p) ^ load64(q)) | (load64(p + 8) ^ load64(q + 8))) == 0;
+#endif
+    }
+    
+#ifdef __AVX2__
+    static bool same32(const char* p, const char* q) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) == 0xFFFFFFFFu;
+    }
+#endif
+};
 
+// Maps identifier strings to dense integer IDs so that scope lookups
+// never have to compare strings. Characters are copied into fixed chunks
+// that never move, so name(id) stays valid for the interner's lifetime.
+class StringInterner {
+    std::pmr::vector<std::string_view> names;
+    std::pmr::vector<uint64_t> hashes;  // Hash of names[id], kept to avoid rehashing on growth
+    std::pmr::vector<SymbolId> slots;   // Open addressing, kNoSymbol marks an empty slot
+    std::pmr::vector<std::pmr::vector<char>> chunks; // Buffers move with their vector, never reallocate
+    char* cursor = nullptr;
+    size_t remaining = 0;
+    
+    static constexpr size_t kChunkSize = 16 * 1024;
+    
+    std::string_view store(std::string_view name) {
+        if (name.size() > remaining) {
+            size_t size = std::max(kChunkSize, name.size());
+            chunks.emplace_back(size);
+            cursor = chunks.back().data();
+            remaining = size;
+        }
+        if (!name.empty()) std::memcpy(cursor, name.data(), name.size());
+        std::string_view stored(cursor, name.size());
+        cursor += name.size();
+        remaining -= name.size();
+        return stored;
     }
     
-    void analyze(std::shared_ptr<ASTNode> root) {
-        visit(root);
+public:
+    explicit StringInterner(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : names(resource), hashes(resource), slots(resource), chunks(resource) {}
+    
+    static uint64_t hash_name(std::string_view name) {
+        return NameKernel::hash(name);
     }
     
 private:
-    void enter_scope() {
-        scope_stack.emplace_back();
+    size_t probe(std::string_view name, uint64_t h) const {
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        while (slots[i] != kNoSymbol) {
+            SymbolId id = slots[i];
+            if (hashes[id] == h && NameKernel::equal(names[id], name)) break;
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+    
+    void grow() {
+        std::pmr::vector<SymbolId> old = std::move(slots);
+        slots.assign(old.empty() ? 64 : old.size() * 2, kNoSymbol);
+        size_t mask = slots.size() - 1;
+        for (SymbolId id : old) {
+            if (id == kNoSymbol) continue;
+            size_t i = hashes[id] & mask;
+            while (slots[i] != kNoSymbol) i = (i + 1) & mask;
+            slots[i] = id;
+        }
+    }
+    
+public:
+    SymbolId intern(std::string_view name) {
+        // Keep the load factor at or below 1/2
+        if ((names.size() + 1) * 2 > slots.size()) grow();
+        
+        uint64_t h = hash_name(name);
+        size_t i = probe(name, h);
+        if (slots[i] == kNoSymbol) {
+            slots[i] = static_cast<SymbolId>(names.size());
+            names.push_back(store(name));
+            hashes.push_back(h);
+        }
+        return slots[i];
+    }
+    
+    // Returns kNoSymbol for names that were never interned
+    SymbolId find(std::string_view name) const {
+        if (slots.empty()) return kNoSymbol;
+        return slots[probe(name, hash_name(name))];
+    }
+    
+    std::string_view name(SymbolId id) const {
+        return names[id];
+    }
+    
+    size_t size() const {
+        return names.size();
+    }
+};
+
+// One binding of a name in some scope. Bindings form a chain through the
+// binding they shadow, so the innermost visible symbol is always the head.
+constexpr uint32_t kNoBinding = UINT32_MAX;
+
+struct Binding {
+    Symbol* symbol;    // Owned by the analyzer's arena, stable for its lifetime
+    SymbolId id;
+    uint32_t shadowed; // Binding restored when this one goes out of scope
+};
+
+// Struct-of-arrays form of the AST, kept alongside the node classes.
+// Nodes are laid out breadth-first so that every function body is one
+// contiguous [child_begin, child_end) slice of the node arrays, and the
+// analyzer can walk a body front to back without chasing pointers.
+constexpr uint32_t kNoIndex = UINT32_MAX;
+
+struct FlatAST {
+    // Per node
+    std::vector<NodeKind> kinds;
+    std::vector<int> lines;
+    std::vector<uint32_t> names;        // Into strings, kNoIndex if the kind has no name
+    std::vector<uint32_t> types;        // Return type or annotation, kNoIndex if absent
+    std::vector<uint32_t> child_begin;  // Function body slice
+    std::vector<uint32_t> child_end;
+    std::vector<uint32_t> param_begin;  // Function parameter slice
+    std::vector<uint32_t> param_end;
+    std::vector<uint32_t> operands;     // Declaration initializer or opaque node, kNoIndex if none
+    
+    // Per parameter
+    std::vector<uint32_t> param_names;
+    std::vector<uint32_t> param_types;
+    std::vector<int> param_lines;
+    
+    // Expressions are not flattened yet; kinds the flat form doesn't model
+    // are carried through as opaque nodes so the round trip is lossless.
+    std::vector<std::shared_ptr<ExpressionNode>> expressions;
+    std::vector<std::shared_ptr<ASTNode>> opaque_nodes;
+    
+    StringInterner strings;
+    
+    size_t size() const {
+        return kinds.size();
+    }
+    
+    static FlatAST from_tree(const std::shared_ptr<ASTNode>& root) {
+        FlatAST ast;
+        if (!root) return ast;
+        
+        // Source node of each flat index; a function's children are appended
+        // when the scan reaches it, which yields the breadth-first layout.
+        std::vector<const std::shared_ptr<ASTNode>*> sources;
+        ast.append(root, sources);
+        
+        for (uint32_t i = 0; i < sources.size(); ++i) {
+            const ASTNode* node = sources[i]->get();
+            if (ast.kinds[i] != NodeKind::Function) continue;
+            
+            auto func = static_cast<const FunctionNode*>(node);
+            ast.param_begin[i] = static_cast<uint32_t>(ast.param_names.size());
+            for (const auto& param : func->parameters) {
+                ast.param_names.push_back(ast.strings.intern(param->name));
+                ast.param_types.push_back(ast.strings.intern(param->type));
+                ast.param_lines.push_back(param->line);
+            }
+            ast.param_end[i] = static_cast<uint32_t>(ast.param_names.size());
+            
+            ast.child_begin[i] = static_cast<uint32_t>(ast.kinds.size());
+            for (const auto& stmt : func->body) {
+                if (stmt) ast.append(stmt, sources);
+            }
+            ast.child_end[i] = static_cast<uint32_t>(ast.kinds.size());
+        }
+        return ast;
+    }
+    
+    std::shared_ptr<ASTNode> to_tree() const {
+        if (kinds.empty()) return nullptr;
+        
+        // Build back to front: children always have higher indices than
+        // their parent, so they're complete by the time the parent is.
+        std::vector<std::shared_ptr<ASTNode>> nodes(kinds.size());
+        for (size_t i = kinds.size(); i-- > 0;) {
+            switch (kinds[i]) {
+                case NodeKind::Function: {
+                    auto func = std::make_shared<FunctionNode>();
+                    func->name = strings.name(names[i]);
+                    func->return_type = strings.name(types[i]);
+                    for (uint32_t p = param_begin[i]; p < param_end[i]; ++p) {
+                        auto param = std::make_shared<ParameterNode>();
+                        param->name = strings.name(param_names[p]);
+                        param->type = strings.name(param_types[p]);
+                        param->line = param_lines[p];
+                        func->parameters.push_back(param);
+                    }
+                    for (uint32_t c = child_begin[i]; c < child_end[i]; ++c) {
+                        func->body.push_back(nodes[c]);
+                    }
+                    nodes[i] = func;
+                    break;
+                }
+                case NodeKind::LetDeclaration:
+                    nodes[i] = rebuild_decl<LetDeclarationNode>(i);
+                    break;
+                case NodeKind::VarDeclaration:
+                    nodes[i] = rebuild_decl<VarDeclarationNode>(i);
+                    break;
+                case NodeKind::ConstDeclaration:
+                    nodes[i] = rebuild_decl<ConstDeclarationNode>(i);
+                    break;
+                default:
+                    nodes[i] = opaque_nodes[operands[i]];
+                    continue;
+            }
+            nodes[i]->line = lines[i];
+        }
+        return nodes[0];
+    }
+    
+private:
+    void append(const std::shared_ptr<ASTNode>& node, std::vector<const std::shared_ptr<ASTNode>*>& sources) {
+        uint32_t name = kNoIndex;
+        uint32_t type = kNoIndex;
+        uint32_t operand = kNoIndex;
+        
+        switch (node->kind) {
+            case NodeKind::Function: {
+                auto func = static_cast<const FunctionNode*>(node.get());
+                name = strings.intern(func->name);
+                type = strings.intern(func->return_type);
+                break;
+            }
+            case NodeKind::LetDeclaration:
+                append_decl(static_cast<const LetDeclarationNode*>(node.get()), name, type, operand);
+                break;
+            case NodeKind::VarDeclaration:
+                append_decl(static_cast<const VarDeclarationNode*>(node.get()), name, type, operand);
+                break;
+            case NodeKind::ConstDeclaration:
+                append_decl(static_cast<const ConstDeclarationNode*>(node.get()), name, type, operand);
+                break;
+            default:
+                operand = static_cast<uint32_t>(opaque_nodes.size());
+                opaque_nodes.push_back(node);
+                break;
+        }
+        
+        kinds.push_back(node->kind);
+        lines.push_back(node->line);
+        names.push_back(name);
+        types.push_back(type);
+        child_begin.push_back(0);
+        child_end.push_back(0);
+        param_begin.push_back(0);
+        param_end.push_back(0);
+        operands.push_back(operand);
+        sources.push_back(&node);
+    }
+    
+    template <typename Decl>
+    void append_decl(const Decl* decl, uint32_t& name, uint32_t& type, uint32_t& operand) {
+        name = strings.intern(decl->name);
+        if (decl->type_annotation) {
+            type = strings.intern(*decl->type_annotation);
+        }
+        if (decl->initializer) {
+            operand = static_cast<uint32_t>(expressions.size());
+            expressions.push_back(decl->initializer);
+        }
+    }
+    
+    template <typename Decl>
+    std::shared_ptr<Decl> rebuild_decl(size_t i) const {
+        auto decl = std::make_shared<Decl>();
+        decl->name = strings.name(names[i]);
+        if (types[i] != kNoIndex) {
+            decl->type_annotation = std::string(strings.name(types[i]));
+        }
+        if (operands[i] != kNoIndex) {
+            decl->initializer = expressions[operands[i]];
+        }
+        return decl;
+    }
+};
+
+// Fixed-size pool with one task queue per worker. A worker drains its own
+// queue front to back and steals from the back of the others when idle.
+// The calling thread takes part as worker 0.
+class ThreadPool {
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+    
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned, size_t)>* job = nullptr;
+    uint64_t generation = 0;
+    unsigned active = 0;
+    bool stopping = false;
+    
+    bool pop_local(unsigned worker, size_t& item) {
+        Queue& q = *queues[worker];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.items.empty()) return false;
+        item = q.items.front();
+        q.items.pop_front();
+        return true;
+    }
+    
+    bool steal(unsigned worker, size_t& item) {
+        for (unsigned i = 1; i < queues.size(); ++i) {
+            Queue& q = *queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (!q.items.empty()) {
+                item = q.items.back();
+                q.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // No task enqueues more work, so empty queues everywhere means done
+    void work(unsigned worker) {
+        size_t item;
+        while (pop_local(worker, item) || steal(worker, item)) {
+            (*job)(worker, item);
+        }
+    }
+    
+    void worker_main(unsigned worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            work(worker);
+            std::lock_guard<std::mutex> guard(lock);
+            if (--active == 0) done.notify_one();
+        }
+    }
+    
+public:
+    explicit ThreadPool(unsigned size = std::thread::hardware_concurrency()) {
+        if (size == 0) size = 1;
+        for (unsigned i = 0; i < size; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (unsigned i = 1; i < size; ++i) {
+            threads.emplace_back(&ThreadPool::worker_main, this, i);
+        }
+    }
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+    
+    unsigned size() const {
+        return static_cast<unsigned>(queues.size());
+    }
+    
+    // Runs task(worker, i) for every i in [0, count) and blocks until all
+    // calls have returned. task must not throw.
+    void parallel_for(size_t count, const std::function<void(unsigned, size_t)>& task) {
+        // Contiguous chunks keep neighbouring items on the same worker
+        for (unsigned w = 0; w < size(); ++w) {
+            size_t begin = count * w / size();
+            size_t end = count * (w + 1) / size();
+            std::lock_guard<std::mutex> guard(queues[w]->lock);
+            for (size_t i = begin; i < end; ++i) queues[w]->items.push_back(i);
+        }
+        
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            job = &task;
+            active = static_cast<unsigned>(threads.size());
+            ++generation;
+        }
+        wake.notify_all();
+        
+        work(0);
+        
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&] { return active == 0; });
+        job = nullptr;
+    }
+};
+
+// Dense, growable bitset indexed by dataflow slot
+class SlotBitset {
+    std::pmr::vector<uint64_t> words;
+    
+public:
+    explicit SlotBitset(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : words(resource) {}
+    
+    void ensure(size_t bits) {
+        size_t needed = (bits + 63) / 64;
+        if (needed > words.size()) words.resize(std::max(needed, words.size() * 2), 0);
+    }
+    
+    void set(size_t bit) {
+        words[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    
+    void reset(size_t bit) {
+        words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+    }
+    
+    bool test(size_t bit) const {
+        return (words[bit / 64] >> (bit % 64)) & 1;
+    }
+    
+    // Calls fn for each clear bit in [begin, end), in increasing order.
+    // Runs of fully set words are skipped two at a time with SSE2.
+    template <typename Fn>
+    void for_each_clear(size_t begin, size_t end, Fn&& fn) const {
+        if (begin >= end) return;
+        size_t first = begin / 64;
+        size_t last = (end - 1) / 64;
+        
+        size_t w = first;
+        while (w <= last) {
+#ifdef __SSE2__
+            if (w + 1 < last) {
+                __m128i pair = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&words[w]));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(pair, _mm_set1_epi32(-1))) == 0xFFFF) {
+                    w += 2;
+                    continue;
+                }
+            }
+#endif
+            uint64_t clear = ~words[w];
+            if (w == first) clear &= ~uint64_t(0) << (begin % 64);
+            if (w == last && end % 64) clear &= ~(~uint64_t(0) << (end % 64));
+            while (clear) {
+                fn(w * 64 + static_cast<size_t>(__builtin_ctzll(clear)));
+                clear &= clear - 1;
+            }
+            ++w;
+        }
+    }
+};
+
+// Side table of inferred expression types, filled as expressions are
+// checked so that later passes can read them back instead of re-walking
+// the subtree. The node classes carry no ID field, so a node's address is
+// its ID, whether it is a heap node or a record in a mapped AstImage;
+// a shared subtree has one entry. Each entry records the scope version it
+// was inferred under, or kAnyScope if its subtree names nothing, so that
+// a subtree shared between scopes is re-checked in each.
+class ExpressionTypeCache {
+    // A slot is live only while its generation is current, so clear()
+    // empties the table without touching it
+    struct Slot {
+        const void* node = nullptr;
+        TypeInfo type;
+        uint32_t generation = 0;
+        uint32_t scope = 0;
+    };
+    
+    std::pmr::vector<Slot> slots;
+    size_t count = 0;
+    uint32_t generation = 1;
+    
+    bool live(const Slot& slot) const {
+        return slot.generation == generation;
+    }
+    
+    static size_t hash_node(const void* node) {
+        return static_cast<size_t>((reinterpret_cast<uintptr_t>(node) >> 4) * 0x9E3779B97F4A7C15ull >> 32);
+    }
+    
+    size_t probe(const void* node) const {
+        size_t mask = slots.size() - 1;
+        size_t i = hash_node(node) & mask;
+        while (live(slots[i]) && slots[i].node != node) i = (i + 1) & mask;
+        return i;
+    }
+    
+    void grow() {
+        std::pmr::vector<Slot> old = std::move(slots);
+        slots.assign(old.empty() ? 64 : old.size() * 2, Slot{});
+        for (const auto& slot : old) {
+            if (live(slot)) slots[probe(slot.node)] = slot;
+        }
+    }
+    
+public:
+    static constexpr uint32_t kAnyScope = 0;
+    
+    explicit ExpressionTypeCache(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : slots(resource) {}
+    
+    // The latest type inferred for node, under whichever scope
+    const TypeInfo* find(const void* node) const {
+        if (slots.empty()) return nullptr;
+        const Slot& slot = slots[probe(node)];
+        return live(slot) ? &slot.type : nullptr;
+    }
+    
+    // Only a type that still holds under scope
+    const TypeInfo* find(const void* node, uint32_t scope) const {
+        if (slots.empty()) return nullptr;
+        const Slot& slot = slots[probe(node)];
+        return live(slot) && (slot.scope == kAnyScope || slot.scope == scope) ? &slot.type : nullptr;
+    }
+    
+    bool scope_independent(const void* node) const {
+        if (!node) return true;
+        if (slots.empty()) return false;
+        const Slot& slot = slots[probe(node)];
+        return live(slot) && slot.scope == kAnyScope;
+    }
+    
+    void insert(const void* node, TypeInfo type, uint32_t scope) {
+        if ((count + 1) * 2 > slots.size()) grow();
+        Slot& slot = slots[probe(node)];
+        if (!live(slot)) {
+            slot.node = node;
+            slot.generation = generation;
+            ++count;
+        }
+        slot.type = type;
+        slot.scope = scope;
+    }
+    
+    // Keeps the table, sized for the largest unit seen so far. O(1) but
+    // once every 2^32 calls, when the generations wrap around.
+    void clear() {
+        if (!count) return;
+        count = 0;
+        if (++generation == 0) {
+            std::fill(slots.begin(), slots.end(), Slot{});
+            generation = 1;
+        }
+    }
+    
+    // Like clear(), but also hands the slots back to the memory resource
+    void release() {
+        slots = std::pmr::vector<Slot>(slots.get_allocator());
+        count = 0;
+    }
+    
+    size_t size() const {
+        return count;
+    }
+};
+
+// Thrown out of an analysis whose CancellationToken was cancelled. The
+// analyzer is ready for the next begin_unit() afterwards.
+class AnalysisCancelled : public std::runtime_error {
+public:
+    AnalysisCancelled() : std::runtime_error("Analysis cancelled") {}
+};
+
+// Thrown at a check point when the analyzer is still over its memory
+// budget after dropping everything optional
+class MemoryBudgetExceeded : public std::runtime_error {
+public:
+    size_t live_bytes;
+    size_t budget;
+    
+    MemoryBudgetExceeded(size_t live_bytes, size_t budget)
+        : std::runtime_error("Memory budget of " + std::to_string(budget) + " bytes exceeded (" +
+                             std::to_string(live_bytes) + " live)"),
+          live_bytes(live_bytes), budget(budget) {}
+};
+
+// Cooperative cancellation flag shared by a caller and a running
+// analysis; copies share one flag. The analyzer polls it between
+// top-level nodes and whenever a function scope opens or closes.
+class CancellationToken {
+    std::shared_ptr<std::atomic<bool>> flag = std::make_shared<std::atomic<bool>>(false);
+    
+public:
+    void cancel() const {
+        flag->store(true, std::memory_order_relaxed);
+    }
+    
+    bool cancelled() const {
+        return flag->load(std::memory_order_relaxed);
+    }
+};
+
+enum class DiagnosticCode : uint8_t {
+    DuplicateFunction,
+    DuplicateParameter,
+    DuplicateVariable,
+    DuplicateConstant,
+    LetTypeMismatch,
+    VarTypeMismatch,
+    ConstTypeMismatch,
+    VarRequiresInitializer,
+    ConstRequiresInitializer,
+    UndefinedName,
+    FunctionUsedAsValue,
+    UnknownBinaryOperator,
+    InvalidBinaryOperands,
+    UnknownUnaryOperator,
+    InvalidUnaryOperand,
+    UndefinedFunction,
+    NotAFunction,
+    ArgumentCount,
+    ArgumentType,
+    UnknownType,
+    UninitializedUse,
+    UnusedVariable,
+    UnusedConstant,
+    ConstantOverflow,
+    DivisionByZero,
+    ConstantOutOfRange,
+    Count
+};
+
+static_assert(static_cast<unsigned>(DiagnosticCode::Count) <= 32, "Suppression masks are 32 bits wide");
+
+enum class Severity : uint8_t {
+    Note, Warning, Error
+};
+
+constexpr Severity severity_of(DiagnosticCode code) {
+    switch (code) {
+        case DiagnosticCode::UnusedVariable:
+        case DiagnosticCode::UnusedConstant:
+            return Severity::Warning;
+        default:
+            return Severity::Error;
+    }
+}
+
+// Bit for code in DiagnosticOptions::suppressed
+constexpr uint32_t diagnostic_bit(DiagnosticCode code) {
+    return 1u << static_cast<unsigned>(code);
+}
+
+class SemanticError : public std::runtime_error {
+public:
+    int line;
+    DiagnosticCode code;
+    SemanticError(const std::string& msg, int line, DiagnosticCode code) 
+        : std::runtime_error(msg), line(line), code(code) {}
+};
+
+struct Diagnostic {
+    int line;
+    std::string message;
+    DiagnosticCode code;
+    Severity severity;
+};
+
+// A diagnostic as recorded: only handles, rendered to text on demand by
+// the analyzer that recorded it
+struct DiagnosticRecord {
+    DiagnosticCode code;
+    int line;
+    SymbolId name = kNoSymbol; // Interned name, operator or type spelling the error is about
+    TypeInfo expected;         // Declared or parameter type, for mismatches
+    TypeInfo actual;           // Type found instead
+    uint32_t counts[2] = {};   // ArgumentCount: expected, got; ArgumentType: parameter index
+};
+
+struct DiagnosticOptions {
+    bool throw_on_error = true;  // false: record every error and keep going, never throw
+    size_t error_limit = 0;      // Stop analysis after this many errors, warnings aside; 0 for no limit
+    size_t reserve = 256;        // Diagnostics preallocated up front
+    Severity min_severity = Severity::Note; // Less severe diagnostics are dropped unrecorded
+    uint32_t suppressed = 0;     // diagnostic_bit()s of codes to drop; they never throw either
+};
+
+#ifdef SEMANTIC_INSTRUMENT
+// Hot-path counters and per-kind visit times for one analyzer. Visit times
+// are exclusive: a function's entry covers its signature and parameters,
+// while its statements are timed under their own kinds.
+struct AnalyzerStats {
+    struct VisitTime {
+        uint64_t count = 0;
+        uint64_t ns = 0;
+    };
+    
+    uint64_t find_symbol_calls = 0;
+    uint64_t lookup_levels = 0;     // Local scopes, global table and imports consulted
+    uint64_t scopes_entered = 0;
+    uint64_t scopes_exited = 0;
+    uint64_t max_scope_depth = 0;
+    uint64_t errors_thrown = 0;
+    uint64_t errors_recorded = 0;
+    uint64_t errors_suppressed = 0;
+    std::unordered_map<std::string, uint64_t> parse_type_hits; // Keyed by the type name as written
+    std::unordered_map<int, VisitTime> visit_times;            // Keyed by NodeKind
+    
+    static const char* kind_name(int kind) {
+        switch (static_cast<NodeKind>(kind)) {
+            case NodeKind::Function: return "Function";
+            case NodeKind::Parameter: return "Parameter";
+            case NodeKind::LetDeclaration: return "LetDeclaration";
+            case NodeKind::VarDeclaration: return "VarDeclaration";
+            case NodeKind::ConstDeclaration: return "ConstDeclaration";
+            case NodeKind::IntegerLiteral: return "IntegerLiteral";
+            case NodeKind::FloatLiteral: return "FloatLiteral";
+            case NodeKind::StringLiteral: return "StringLiteral";
+            case NodeKind::BoolLiteral: return "BoolLiteral";
+            case NodeKind::Identifier: return "Identifier";
+            case NodeKind::BinaryExpression: return "BinaryExpression";
+            case NodeKind::UnaryExpression: return "UnaryExpression";
+            case NodeKind::CallExpression: return "CallExpression";
+            default: return "Other";
+        }
+    }
+    
+    static void append_json_string(std::string& out, std::string_view text) {
+        out += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+    
+    // Keys within each object are sorted, so reports diff cleanly
+    std::string to_json() const {
+        std::string out = "{\"find_symbol\":{\"calls\":" + std::to_string(find_symbol_calls) +
+                          ",\"levels\":" + std::to_string(lookup_levels) +
+                          "},\"scopes\":{\"entered\":" + std::to_string(scopes_entered) +
+                          ",\"exited\":" + std::to_string(scopes_exited) +
+                          ",\"max_depth\":" + std::to_string(max_scope_depth) +
+                          "},\"errors\":{\"thrown\":" + std::to_string(errors_thrown) +
+                          ",\"recorded\":" + std::to_string(errors_recorded) +
+                          ",\"suppressed\":" + std::to_string(errors_suppressed) + "},\"parse_type\":{";
+        
+        std::vector<std::pair<std::string_view, uint64_t>> hits(parse_type_hits.begin(), parse_type_hits.end());
+        std::sort(hits.begin(), hits.end());
+        for (size_t i = 0; i < hits.size(); ++i) {
+            if (i) out += ',';
+            append_json_string(out, hits[i].first);
+            out += ':' + std::to_string(hits[i].second);
+        }
+        
+        out += "},\"visit\":{";
+        std::vector<std::pair<std::string_view, VisitTime>> times;
+        for (const auto& entry : visit_times) times.emplace_back(kind_name(entry.first), entry.second);
+        std::sort(times.begin(), times.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (size_t i = 0; i < times.size(); ++i) {
+            if (i) out += ',';
+            append_json_string(out, times[i].first);
+            out += ":{\"count\":" + std::to_string(times[i].second.count) +
+                   ",\"ns\":" + std::to_string(times[i].second.ns) + '}';
+        }
+        return out + "}}";
+    }
+};
+
+// Adds the lifetime of the scope to one kind's visit time
+class VisitTimer {
+    AnalyzerStats::VisitTime& slot;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+public:
+    VisitTimer(AnalyzerStats& stats, NodeKind kind) : slot(stats.visit_times[static_cast<int>(kind)]) {}
+    
+    ~VisitTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        slot.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        ++slot.count;
+    }
+};
+#endif
+
+// Receives every semantic error. Suppressed codes and severities below
+// the minimum are dropped before anything is built. In throwing mode the
+// first remaining error raises a SemanticError as before; otherwise its
+// record is appended to a buffer and the analyzer recovers and carries on
+// until the error limit is reached.
+class DiagnosticSink {
+    std::pmr::vector<DiagnosticRecord> records;
+    DiagnosticOptions options;
+    size_t errors = 0; // Records of Severity::Error, the ones the limit counts
+    
+public:
+    SEMANTIC_STAT(AnalyzerStats* stats = nullptr;)
+    
+    explicit DiagnosticSink(const DiagnosticOptions& options = {},
+                            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : records(resource), options(options) {
+        records.reserve(options.reserve);
+    }
+    
+    bool wants(DiagnosticCode code) const {
+        bool wanted = (options.suppressed & diagnostic_bit(code)) == 0 && severity_of(code) >= options.min_severity;
+        SEMANTIC_STAT(if (!wanted) ++stats->errors_suppressed;)
+        return wanted;
+    }
+    
+    // render is only called when the error has to be thrown. Warnings are
+    // recorded in either mode.
+    template <typename Render>
+    void report(const DiagnosticRecord& record, Render&& render) {
+        if (options.throw_on_error && severity_of(record.code) == Severity::Error) {
+            SEMANTIC_STAT(++stats->errors_thrown;)
+            throw SemanticError(render(record), record.line, record.code);
+        }
+        if (!limit_reached()) {
+            SEMANTIC_STAT(++stats->errors_recorded;)
+            records.push_back(record);
+            if (severity_of(record.code) == Severity::Error) ++errors;
+        }
+    }
+    
+    bool limit_reached() const {
+        return options.error_limit != 0 && errors >= options.error_limit;
+    }
+    
+    const DiagnosticOptions& settings() const {
+        return options;
+    }
+    
+    const std::pmr::vector<DiagnosticRecord>& all() const {
+        return records;
+    }
+    
+    // Starts the error limit over while keeping the records, so that it
+    // can apply to each of several groups collected in one sink
+    void restart_limit() {
+        errors = 0;
+    }
+    
+    void clear() {
+        records.clear();
+        errors = 0;
+    }
+};
+
+// Name resolutions recorded during analysis: each use site (identifier or
+// call) with the Symbol it resolved to. Entries are appended as analysis
+// runs; the query orders are built on first query after a change, as
+// index permutations over the one entry array.
+class ReferenceIndex {
+public:
+    struct Reference {
+        const void* use;        // The use node, or its record in a mapped AstImage
+        const Symbol* symbol;
+        int line;
+    };
+    
+    // Entries selected by one query, in line order
+    class View {
+        const Reference* refs = nullptr;
+        const uint32_t* first = nullptr;
+        const uint32_t* last = nullptr;
+        
+    public:
+        class iterator {
+            const Reference* refs;
+            const uint32_t* at;
+            
+        public:
+            iterator(const Reference* refs, const uint32_t* at) : refs(refs), at(at) {}
+            const Reference& operator*() const { return refs[*at]; }
+            const Reference* operator->() const { return &refs[*at]; }
+            iterator& operator++() { ++at; return *this; }
+            bool operator==(const iterator& other) const { return at == other.at; }
+            bool operator!=(const iterator& other) const { return at != other.at; }
+        };
+        
+        View() = default;
+        View(const Reference* refs, const uint32_t* first, const uint32_t* last)
+            : refs(refs), first(first), last(last) {}
+        
+        iterator begin() const { return iterator(refs, first); }
+        iterator end() const { return iterator(refs, last); }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+    };
+    
+private:
+    std::pmr::vector<Reference> refs;
+    mutable std::pmr::vector<uint32_t> by_use;     // Sorted by use node
+    mutable std::pmr::vector<uint32_t> by_line;    // Sorted by line
+    mutable std::pmr::vector<uint32_t> by_symbol;  // Grouped by symbol, by line within a group
+    mutable std::pmr::vector<const Symbol*> symbols;   // Distinct symbols, sorted
+    mutable std::pmr::vector<uint32_t> symbol_begin;   // CSR offsets into by_symbol, one extra at the end
+    mutable bool built = true;
+    
+    void build() const {
+        if (built) return;
+        std::less<const void*> before;
+        
+        by_line.resize(refs.size());
+        for (uint32_t i = 0; i < refs.size(); ++i) by_line[i] = i;
+        std::stable_sort(by_line.begin(), by_line.end(),
+                         [&](uint32_t a, uint32_t b) { return refs[a].line < refs[b].line; });
+        
+        // Stable over the line order, so uses of one node stay line-sorted
+        by_use = by_line;
+        std::stable_sort(by_use.begin(), by_use.end(),
+                         [&](uint32_t a, uint32_t b) { return before(refs[a].use, refs[b].use); });
+        by_symbol = by_line;
+        std::stable_sort(by_symbol.begin(), by_symbol.end(),
+                         [&](uint32_t a, uint32_t b) { return before(refs[a].symbol, refs[b].symbol); });
+        
+        symbols.clear();
+        symbol_begin.clear();
+        for (uint32_t k = 0; k < by_symbol.size(); ++k) {
+            const Symbol* sym = refs[by_symbol[k]].symbol;
+            if (symbols.empty() || symbols.back() != sym) {
+                symbols.push_back(sym);
+                symbol_begin.push_back(k);
+            }
+        }
+        symbol_begin.push_back(static_cast<uint32_t>(by_symbol.size()));
+        built = true;
+    }
+    
+public:
+    explicit ReferenceIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : refs(resource), by_use(resource), by_line(resource), by_symbol(resource),
+          symbols(resource), symbol_begin(resource) {}
+    
+    void add(const void* use, const Symbol* symbol, int line) {
+        refs.push_back(Reference{use, symbol, line});
+        built = false;
+    }
+    
+    void clear() {
+        refs.clear();
+        built = false;
+    }
+    
+    // Like clear(), but also hands every array back to the memory resource
+    void release() {
+        refs = std::pmr::vector<Reference>(refs.get_allocator());
+        for (auto* order : {&by_use, &by_line, &by_symbol, &symbol_begin}) {
+            *order = std::pmr::vector<uint32_t>(order->get_allocator());
+        }
+        symbols = std::pmr::vector<const Symbol*>(symbols.get_allocator());
+        built = false;
+    }
+    
+    size_t size() const {
+        return refs.size();
+    }
+    
+    // Symbol the use site resolved to, nullptr if it was never resolved
+    const Symbol* definition(const void* use) const {
+        build();
+        std::less<const void*> before;
+        auto it = std::lower_bound(by_use.begin(), by_use.end(), use,
+                                   [&](uint32_t i, const void* key) { return before(refs[i].use, key); });
+        return it != by_use.end() && refs[*it].use == use ? refs[*it].symbol : nullptr;
+    }
+    
+    View references(const Symbol* symbol) const {
+        build();
+        auto it = std::lower_bound(symbols.begin(), symbols.end(), symbol, std::less<const Symbol*>());
+        if (it == symbols.end() || *it != symbol) return View{};
+        size_t group = static_cast<size_t>(it - symbols.begin());
+        return View(refs.data(), by_symbol.data() + symbol_begin[group], by_symbol.data() + symbol_begin[group + 1]);
+    }
+    
+    // Every use on line, e.g. to map a cursor position to its symbol
+    View at_line(int line) const {
+        build();
+        auto range = std::equal_range(by_line.begin(), by_line.end(), line, LineOrder{&refs});
+        return View(refs.data(), by_line.data() + (range.first - by_line.begin()),
+                    by_line.data() + (range.second - by_line.begin()));
+    }
+    
+private:
+    struct LineOrder {
+        const std::pmr::vector<Reference>* refs;
+        bool operator()(uint32_t i, int line) const { return (*refs)[i].line < line; }
+        bool operator()(int line, uint32_t i) const { return line < (*refs)[i].line; }
+    };
+};
+
+// Read-only, memory-mapped table of the symbols a unit exports, so that
+// dependent units can resolve them without re-analyzing the library.
+// Layout, all fields native-endian 32-bit:
+//
+//   Header | slots[slot_count] | records[symbol_count] | params[param_count] | names
+//
+// slots is an open-addressing table keyed by StringInterner::hash_name,
+// holding record index + 1 (0 is empty). Handles into a TypeTable are
+// local to the writing analyzer and load back as Unknown.
+class SymbolImage {
+public:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t symbol_count;
+        uint32_t slot_count;
+        uint32_t param_count;
+        uint32_t name_bytes;
+    };
+    
+    struct Record {
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t symbol_type;
+        uint32_t type;
+        uint32_t param_begin;
+        uint32_t param_count;
+        int32_t line;
+        uint32_t value_kind;    // ConstantValue::Kind, None unless a constant folded
+        uint32_t value_bits[2]; // The value's 64 bits, low word first
+    };
+    
+    // 2: slots keyed by NameKernel::hash instead of FNV-1a
+    // 3: folded constant values
+    static constexpr uint32_t kVersion = 3;
+    
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    const Header* header = nullptr;
+    const uint32_t* slots = nullptr;
+    const Record* records = nullptr;
+    const uint32_t* params = nullptr;
+    const char* names = nullptr;
+    
+    [[noreturn]] static void fail(const std::string& path, const char* what) {
+        throw std::runtime_error("Symbol image " + path + ": " + what);
+    }
+    
+    static TypeInfo load_type(uint32_t raw) {
+        TypeInfo type = TypeInfo::from_raw(raw);
+        return type.table_index() == 0 ? type : TypeInfo{};
+    }
+    
+    static void store_value(const ConstantValue& value, Record& rec) {
+        uint64_t bits = 0;
+        switch (value.kind) {
+            case ConstantValue::Int: bits = static_cast<uint64_t>(value.integer); break;
+            case ConstantValue::Float: std::memcpy(&bits, &value.real, sizeof(bits)); break;
+            case ConstantValue::Bool: bits = value.boolean ? 1 : 0; break;
+            case ConstantValue::None: break;
+        }
+        rec.value_kind = value.kind;
+        rec.value_bits[0] = static_cast<uint32_t>(bits);
+        rec.value_bits[1] = static_cast<uint32_t>(bits >> 32);
+    }
+    
+public:
+    static void write(const std::string& path, const std::vector<const Symbol*>& symbols) {
+        uint32_t slot_count = 16;
+        while (slot_count < symbols.size() * 2) slot_count *= 2;
+        
+        std::vector<uint32_t> table(slot_count, 0);
+        std::vector<Record> out;
+        std::vector<uint32_t> param_types;
+        std::string name_bytes;
+        for (const Symbol* sym : symbols) {
+            size_t mask = slot_count - 1;
+            size_t i = StringInterner::hash_name(sym->name) & mask;
+            while (table[i]) {
+                const Record& other = out[table[i] - 1];
+                if (NameKernel::equal(std::string_view(name_bytes).substr(other.name_offset, other.name_length), sym->name)) break;
+                i = (i + 1) & mask;
+            }
+            
+            // A later binding of the same name replaces the earlier one
+            Record rec{static_cast<uint32_t>(name_bytes.size()), static_cast<uint32_t>(sym->name.size()),
+                       static_cast<uint32_t>(sym->symbol_type), sym->type_info.raw(),
+                       static_cast<uint32_t>(param_types.size()), sym->param_count, sym->declaration_line,
+                       ConstantValue::None, {0, 0}};
+            if (sym->symbol_type == SymbolType::Constant) store_value(sym->value, rec);
+            name_bytes += sym->name;
+            for (uint32_t p = 0; p < sym->param_count; ++p) param_types.push_back(sym->param_types[p].raw());
+            
+            if (table[i]) {
+                out[table[i] - 1] = rec;
+            } else {
+                out.push_back(rec);
+                table[i] = static_cast<uint32_t>(out.size());
+            }
+        }
+        
+        Header head{{'S', 'A', 'S', 'Y'}, kVersion, static_cast<uint32_t>(out.size()), slot_count,
+                    static_cast<uint32_t>(param_types.size()), static_cast<uint32_t>(name_bytes.size())};
+        
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) fail(path, "cannot open for writing");
+        // Empty sections may have no storage, and fwrite must not see null
+        auto put = [&](const void* section, size_t size, size_t count) {
+            return count == 0 || std::fwrite(section, size, count, file) == count;
+        };
+        bool ok = put(&head, sizeof(head), 1) && put(table.data(), sizeof(uint32_t), table.size()) &&
+                  put(out.data(), sizeof(Record), out.size()) &&
+                  put(param_types.data(), sizeof(uint32_t), param_types.size()) &&
+                  put(name_bytes.data(), 1, name_bytes.size());
+        if (std::fclose(file) != 0 || !ok) fail(path, "write failed");
+    }
+    
+    explicit SymbolImage(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) fail(path, "cannot open");
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+            ::close(fd);
+            fail(path, "truncated");
+        }
+        length = static_cast<size_t>(st.st_size);
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) fail(path, "mmap failed");
+        data = static_cast<const char*>(mapped);
+        
+        header = reinterpret_cast<const Header*>(data);
+        uint64_t expected = sizeof(Header) + uint64_t(header->slot_count) * sizeof(uint32_t) +
+                            uint64_t(header->symbol_count) * sizeof(Record) +
+                            uint64_t(header->param_count) * sizeof(uint32_t) + header->name_bytes;
+        if (std::memcmp(header->magic, "SASY", 4) != 0 || header->version != kVersion ||
+            header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0 ||
+            expected != length) {
+            ::munmap(const_cast<char*>(data), length);
+            fail(path, "not a symbol image");
+        }
+        
+        slots = reinterpret_cast<const uint32_t*>(header + 1);
+        records = reinterpret_cast<const Record*>(slots + header->slot_count);
+        params = reinterpret_cast<const uint32_t*>(records + header->symbol_count);
+        names = reinterpret_cast<const char*>(params + header->param_count);
+    }
+    
+    SymbolImage(const SymbolImage&) = delete;
+    SymbolImage& operator=(const SymbolImage&) = delete;
+    
+    ~SymbolImage() {
+        ::munmap(const_cast<char*>(data), length);
+    }
+    
+    // nullptr if the image does not export name. Records whose fields point
+    // outside the image are treated as absent.
+    const Record* find(std::string_view name) const {
+        size_t mask = header->slot_count - 1;
+        size_t i = StringInterner::hash_name(name) & mask;
+        for (size_t probes = 0; probes <= mask && slots[i]; ++probes, i = (i + 1) & mask) {
+            if (slots[i] > header->symbol_count) return nullptr;
+            const Record& rec = records[slots[i] - 1];
+            if (uint64_t(rec.name_offset) + rec.name_length > header->name_bytes ||
+                uint64_t(rec.param_begin) + rec.param_count > header->param_count ||
+                rec.symbol_type > static_cast<uint32_t>(SymbolType::Function) ||
+                rec.value_kind > ConstantValue::Bool) {
+                return nullptr;
+            }
+            if (NameKernel::equal(this->name(rec), name)) return &rec;
+        }
+        return nullptr;
+    }
+    
+    std::string_view name(const Record& rec) const {
+        return std::string_view(names + rec.name_offset, rec.name_length);
+    }
+    
+    TypeInfo type(const Record& rec) const {
+        return load_type(rec.type);
+    }
+    
+    TypeInfo param_type(const Record& rec, uint32_t i) const {
+        return load_type(params[rec.param_begin + i]);
+    }
+    
+    ConstantValue value(const Record& rec) const {
+        uint64_t bits = rec.value_bits[0] | uint64_t(rec.value_bits[1]) << 32;
+        ConstantValue value;
+        value.kind = static_cast<ConstantValue::Kind>(rec.value_kind);
+        switch (value.kind) {
+            case ConstantValue::Int: value.integer = static_cast<int64_t>(bits); break;
+            case ConstantValue::Float: std::memcpy(&value.real, &bits, sizeof(bits)); break;
+            case ConstantValue::Bool: value.boolean = bits != 0; break;
+            case ConstantValue::None: break;
+        }
+        return value;
+    }
+    
+    size_t size() const {
+        return header->symbol_count;
+    }
+};
+
+// Node class behind each NodeKind, so handlers can be generated per kind
+// and receive the concrete node type
+template <NodeKind K> struct NodeClass;
+template <> struct NodeClass<NodeKind::Function> { using type = FunctionNode; };
+template <> struct NodeClass<NodeKind::Parameter> { using type = ParameterNode; };
+template <> struct NodeClass<NodeKind::LetDeclaration> { using type = LetDeclarationNode; };
+template <> struct NodeClass<NodeKind::VarDeclaration> { using type = VarDeclarationNode; };
+template <> struct NodeClass<NodeKind::ConstDeclaration> { using type = ConstDeclarationNode; };
+template <> struct NodeClass<NodeKind::IntegerLiteral> { using type = IntegerLiteralNode; };
+template <> struct NodeClass<NodeKind::FloatLiteral> { using type = FloatLiteralNode; };
+template <> struct NodeClass<NodeKind::StringLiteral> { using type = StringLiteralNode; };
+template <> struct NodeClass<NodeKind::BoolLiteral> { using type = BoolLiteralNode; };
+template <> struct NodeClass<NodeKind::Identifier> { using type = IdentifierNode; };
+template <> struct NodeClass<NodeKind::BinaryExpression> { using type = BinaryExpressionNode; };
+template <> struct NodeClass<NodeKind::UnaryExpression> { using type = UnaryExpressionNode; };
+template <> struct NodeClass<NodeKind::CallExpression> { using type = CallExpressionNode; };
+
+constexpr size_t kNodeKindCount = static_cast<size_t>(NodeKind::CallExpression) + 1; // CallExpression is last
+
+// Expression access for the pointer tree. The analyzer's expression checks
+// are written against this interface, so that the mapped form
+// (ImageExpressions) shares them; Node is always a pointer, and its value
+// is the expression's identity.
+struct TreeExpressions {
+    using Node = const ExpressionNode*;
+    
+    static NodeKind kind(Node e) { return e->kind; }
+    static int line(Node e) { return e->line; }
+    static Node left(Node e) { return static_cast<const BinaryExpressionNode*>(e)->left.get(); }
+    static Node right(Node e) { return static_cast<const BinaryExpressionNode*>(e)->right.get(); }
+    static std::string_view binary_op(Node e) { return static_cast<const BinaryExpressionNode*>(e)->op; }
+    static Node operand(Node e) { return static_cast<const UnaryExpressionNode*>(e)->operand.get(); }
+    static std::string_view unary_op(Node e) { return static_cast<const UnaryExpressionNode*>(e)->op; }
+    static std::string_view name(Node e) { return static_cast<const IdentifierNode*>(e)->name; }
+    static std::string_view callee(Node e) { return static_cast<const CallExpressionNode*>(e)->callee; }
+    static size_t arg_count(Node e) { return static_cast<const CallExpressionNode*>(e)->arguments.size(); }
+    static Node arg(Node e, size_t i) { return static_cast<const CallExpressionNode*>(e)->arguments[i].get(); }
+    static int64_t int_value(Node e) { return static_cast<const IntegerLiteralNode*>(e)->value; }
+    static double float_value(Node e) { return static_cast<const FloatLiteralNode*>(e)->value; }
+    static bool bool_value(Node e) { return static_cast<const BoolLiteralNode*>(e)->value; }
+};
+
+// Serialized FlatAST that the analyzer walks in place, straight from an
+// mmap'd file: no node objects are built and names stay in the mapped
+// string pool. Layout, all fields native-endian, every section a multiple
+// of 8 bytes:
+//
+//   Header | nodes[node_count] | params[param_count] | exprs[expr_count] |
+//   strings[string_count] | args[arg_count, padded] | bytes
+//
+// Statement nodes mirror the FlatAST arrays; operand is the initializer of
+// a declaration or the expression of an expression statement. Expressions
+// are written in post-order, so every operand index is below its
+// parent's. The loader checks every index once, which bounds any walk
+// over the image; string literal contents are not stored.
+class AstImage {
+public:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t node_count;
+        uint32_t param_count;
+        uint32_t expr_count;
+        uint32_t string_count;
+        uint32_t arg_count;
+        uint32_t byte_count;
+    };
+    
+    struct Node {
+        uint32_t kind;
+        int32_t line;
+        uint32_t name;
+        uint32_t type;
+        uint32_t child_begin;
+        uint32_t child_end;
+        uint32_t param_begin;
+        uint32_t param_end;
+        uint32_t operand;
+        uint32_t reserved;
+    };
+    
+    struct Param {
+        uint32_t name;
+        uint32_t type;
+        int32_t line;
+        uint32_t reserved;
+    };
+    
+    // a, b, c by kind: Identifier name; Binary left, right, op; Unary
+    // operand, -, op; Call callee, first arg, arg count
+    struct Expr {
+        uint32_t kind;
+        int32_t line;
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+        uint32_t reserved;
+        union {
+            int64_t integer;
+            double real;
+        };
+    };
+    
+    struct String {
+        uint32_t offset;
+        uint32_t length;
+    };
+    
+    static constexpr uint32_t kVersion = 1;
+    
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    const Header* header = nullptr;
+    const Node* nodes = nullptr;
+    const Param* params = nullptr;
+    const Expr* exprs = nullptr;
+    const String* strings = nullptr;
+    const uint32_t* args = nullptr;
+    const char* bytes = nullptr;
+    
+    static uint64_t padded_args(uint64_t count) {
+        return (count + 1) & ~uint64_t(1);
+    }
+    
+    [[noreturn]] static void fail(const std::string& path, const char* what) {
+        throw std::runtime_error("AST image " + path + ": " + what);
+    }
+    
+    // Appends root and whichever of its operands were not written before,
+    // in post-order; returns root's index
+    static uint32_t write_expression(const ExpressionNode* root, std::vector<Expr>& out, std::vector<uint32_t>& arg_out,
+                                     StringInterner& pool,
+                                     std::unordered_map<const ExpressionNode*, uint32_t>& written) {
+        auto index_of = [&](const ExpressionNode* e) { return e ? written.at(e) : kNoIndex; };
+        
+        std::vector<std::pair<const ExpressionNode*, bool>> stack{{root, false}};
+        while (!stack.empty()) {
+            auto [e, expanded] = stack.back();
+            if (written.count(e)) {
+                stack.pop_back();
+                continue;
+            }
+            if (!expanded) {
+                stack.back().second = true;
+                auto push = [&](const ExpressionNode* operand) {
+                    if (operand && !written.count(operand)) stack.emplace_back(operand, false);
+                };
+                switch (e->kind) {
+                    case NodeKind::BinaryExpression:
+                        push(TreeExpressions::right(e));
+                        push(TreeExpressions::left(e));
+                        break;
+                    case NodeKind::UnaryExpression:
+                        push(TreeExpressions::operand(e));
+                        break;
+                    case NodeKind::CallExpression:
+                        for (size_t i = TreeExpressions::arg_count(e); i-- > 0;) push(TreeExpressions::arg(e, i));
+                        break;
+                    default:
+                        break;
+                }
+                continue;
+            }
+            stack.pop_back();
+            
+            Expr rec{static_cast<uint32_t>(e->kind), e->line, kNoIndex, kNoIndex, kNoIndex, 0, {0}};
+            switch (e->kind) {
+                case NodeKind::IntegerLiteral:
+                    rec.integer = TreeExpressions::int_value(e);
+                    break;
+                case NodeKind::FloatLiteral:
+                    rec.real = TreeExpressions::float_value(e);
+                    break;
+                case NodeKind::BoolLiteral:
+                    rec.integer = TreeExpressions::bool_value(e);
+                    break;
+                case NodeKind::Identifier:
+                    rec.a = pool.intern(TreeExpressions::name(e));
+                    break;
+                case NodeKind::BinaryExpression:
+                    rec.a = index_of(TreeExpressions::left(e));
+                    rec.b = index_of(TreeExpressions::right(e));
+                    rec.c = pool.intern(TreeExpressions::binary_op(e));
+                    break;
+                case NodeKind::UnaryExpression:
+                    rec.a = index_of(TreeExpressions::operand(e));
+                    rec.c = pool.intern(TreeExpressions::unary_op(e));
+                    break;
+                case NodeKind::CallExpression:
+                    rec.a = pool.intern(TreeExpressions::callee(e));
+                    rec.b = static_cast<uint32_t>(arg_out.size());
+                    rec.c = static_cast<uint32_t>(TreeExpressions::arg_count(e));
+                    for (size_t i = 0; i < rec.c; ++i) arg_out.push_back(index_of(TreeExpressions::arg(e, i)));
+                    break;
+                default:
+                    break;
+            }
+            written[e] = static_cast<uint32_t>(out.size());
+            out.push_back(rec);
+        }
+        return written.at(root);
+    }
+    
+    bool valid_string(uint32_t s) const {
+        return s < header->string_count;
+    }
+    
+    // Operands refer strictly backwards, kNoIndex where the tree had none
+    bool valid_operand(uint32_t e, uint32_t self) const {
+        return e == kNoIndex || e < self;
+    }
+    
+    bool validate() const {
+        for (uint32_t s = 0; s < header->string_count; ++s) {
+            if (uint64_t(strings[s].offset) + strings[s].length > header->byte_count) return false;
+        }
+        for (uint32_t p = 0; p < header->param_count; ++p) {
+            if (!valid_string(params[p].name) || !valid_string(params[p].type)) return false;
+        }
+        for (uint32_t e = 0; e < header->expr_count; ++e) {
+            const Expr& x = exprs[e];
+            switch (static_cast<NodeKind>(x.kind)) {
+                case NodeKind::IntegerLiteral:
+                case NodeKind::FloatLiteral:
+                case NodeKind::StringLiteral:
+                case NodeKind::BoolLiteral:
+                    break;
+                case NodeKind::Identifier:
+                    if (!valid_string(x.a)) return false;
+                    break;
+                case NodeKind::BinaryExpression:
+                    if (!valid_operand(x.a, e) || !valid_operand(x.b, e) || !valid_string(x.c)) return false;
+                    break;
+                case NodeKind::UnaryExpression:
+                    if (!valid_operand(x.a, e) || !valid_string(x.c)) return false;
+                    break;
+                case NodeKind::CallExpression:
+                    if (!valid_string(x.a) || uint64_t(x.b) + x.c > header->arg_count) return false;
+                    for (uint32_t k = x.b; k < x.b + x.c; ++k) {
+                        if (!valid_operand(args[k], e)) return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+        // The breadth-first layout FlatAST writes: node 0 is the root, and
+        // each function's children and parameters are the next blocks not
+        // handed out yet. So every other node has exactly one parent, and
+        // bodies come after their function, so walks always move forward.
+        uint32_t next_unowned = header->node_count ? 1 : 0;
+        uint32_t next_param = 0;
+        for (uint32_t i = 0; i < header->node_count; ++i) {
+            const Node& n = nodes[i];
+            if (n.kind >= kNodeKindCount) return false;
+            if (n.operand != kNoIndex && n.operand >= header->expr_count) return false;
+            switch (static_cast<NodeKind>(n.kind)) {
+                case NodeKind::Function:
+                    if (!valid_string(n.name) || !valid_string(n.type) ||
+                        n.child_begin <= i || n.child_begin != next_unowned || n.child_begin > n.child_end ||
+                        n.child_end > header->node_count || n.param_begin != next_param ||
+                        n.param_begin > n.param_end || n.param_end > header->param_count) {
+                        return false;
+                    }
+                    next_unowned = n.child_end;
+                    next_param = n.param_end;
+                    break;
+                case NodeKind::LetDeclaration:
+                case NodeKind::VarDeclaration:
+                case NodeKind::ConstDeclaration:
+                    if (!valid_string(n.name) || (n.type != kNoIndex && !valid_string(n.type))) return false;
+                    break;
+                default:
+                    break;
+            }
+        }
+        return next_unowned == header->node_count && next_param == header->param_count;
+    }
+    
+public:
+    static void write(const std::string& path, const FlatAST& ast) {
+        // Keep the FlatAST string indices; expression names are added after them
+        StringInterner pool;
+        for (SymbolId s = 0; s < ast.strings.size(); ++s) pool.intern(ast.strings.name(s));
+        
+        std::vector<Node> out_nodes;
+        std::vector<Param> out_params;
+        std::vector<Expr> out_exprs;
+        std::vector<uint32_t> out_args;
+        std::unordered_map<const ExpressionNode*, uint32_t> written;
+        for (size_t i = 0; i < ast.size(); ++i) {
+            uint32_t operand = kNoIndex;
+            const ExpressionNode* expr = nullptr;
+            switch (ast.kinds[i]) {
+                case NodeKind::LetDeclaration:
+                case NodeKind::VarDeclaration:
+                case NodeKind::ConstDeclaration:
+                    if (ast.operands[i] != kNoIndex) expr = ast.expressions[ast.operands[i]].get();
+                    break;
+                case NodeKind::Function:
+                case NodeKind::Parameter:
+                    break;
+                default:
+                    expr = static_cast<const ExpressionNode*>(ast.opaque_nodes[ast.operands[i]].get());
+                    break;
+            }
+            if (expr) operand = write_expression(expr, out_exprs, out_args, pool, written);
+            out_nodes.push_back(Node{static_cast<uint32_t>(ast.kinds[i]), ast.lines[i], ast.names[i], ast.types[i],
+                                     ast.child_begin[i], ast.child_end[i], ast.param_begin[i], ast.param_end[i],
+                                     operand, 0});
+        }
+        for (size_t p = 0; p < ast.param_names.size(); ++p) {
+            out_params.push_back(Param{ast.param_names[p], ast.param_types[p], ast.param_lines[p], 0});
+        }
+        
+        std::vector<String> out_strings;
+        std::string out_bytes;
+        for (SymbolId s = 0; s < pool.size(); ++s) {
+            std::string_view name = pool.name(s);
+            out_strings.push_back(String{static_cast<uint32_t>(out_bytes.size()), static_cast<uint32_t>(name.size())});
+            out_bytes += name;
+        }
+        
+        Header head{{'S', 'A', 'S', 'T'}, kVersion, static_cast<uint32_t>(out_nodes.size()),
+                    static_cast<uint32_t>(out_params.size()), static_cast<uint32_t>(out_exprs.size()),
+                    static_cast<uint32_t>(out_strings.size()), static_cast<uint32_t>(out_args.size()),
+                    static_cast<uint32_t>(out_bytes.size())};
+        out_args.resize(padded_args(out_args.size()), kNoIndex);
+        
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) fail(path, "cannot open for writing");
+        // Empty sections may have no storage, and fwrite must not see null
+        auto put = [&](const void* section, size_t size, size_t count) {
+            return count == 0 || std::fwrite(section, size, count, file) == count;
+        };
+        bool ok = put(&head, sizeof(head), 1) && put(out_nodes.data(), sizeof(Node), out_nodes.size()) &&
+                  put(out_params.data(), sizeof(Param), out_params.size()) &&
+                  put(out_exprs.data(), sizeof(Expr), out_exprs.size()) &&
+                  put(out_strings.data(), sizeof(String), out_strings.size()) &&
+                  put(out_args.data(), sizeof(uint32_t), out_args.size()) &&
+                  put(out_bytes.data(), 1, out_bytes.size());
+        if (std::fclose(file) != 0 || !ok) fail(path, "write failed");
+    }
+    
+    static void write(const std::string& path, const std::shared_ptr<ASTNode>& root) {
+        write(path, FlatAST::from_tree(root));
+    }
+    
+    explicit AstImage(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) fail(path, "cannot open");
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+            ::close(fd);
+            fail(path, "truncated");
+        }
+        length = static_cast<size_t>(st.st_size);
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) fail(path, "mmap failed");
+        data = static_cast<const char*>(mapped);
+        
+        header = reinterpret_cast<const Header*>(data);
+        uint64_t expected = sizeof(Header) + uint64_t(header->node_count) * sizeof(Node) +
+                            uint64_t(header->param_count) * sizeof(Param) +
+                            uint64_t(header->expr_count) * sizeof(Expr) +
+                            uint64_t(header->string_count) * sizeof(String) +
+                            padded_args(header->arg_count) * sizeof(uint32_t) + header->byte_count;
+        if (std::memcmp(header->magic, "SAST", 4) != 0 || header->version != kVersion || expected != length) {
+            ::munmap(const_cast<char*>(data), length);
+            fail(path, "not an AST image");
+        }
+        
+        nodes = reinterpret_cast<const Node*>(header + 1);
+        params = reinterpret_cast<const Param*>(nodes + header->node_count);
+        exprs = reinterpret_cast<const Expr*>(params + header->param_count);
+        strings = reinterpret_cast<const String*>(exprs + header->expr_count);
+        args = reinterpret_cast<const uint32_t*>(strings + header->string_count);
+        bytes = reinterpret_cast<const char*>(args + padded_args(header->arg_count));
+        if (!validate()) {
+            ::munmap(const_cast<char*>(data), length);
+            fail(path, "corrupt AST image");
+        }
+    }
+    
+    AstImage(const AstImage&) = delete;
+    AstImage& operator=(const AstImage&) = delete;
+    
+    ~AstImage() {
+        ::munmap(const_cast<char*>(data), length);
+    }
+    
+    size_t size() const {
+        return header->node_count;
+    }
+    
+    size_t string_count() const {
+        return header->string_count;
+    }
+    
+    const Node& node(uint32_t i) const {
+        return nodes[i];
+    }
+    
+    const Param& param(uint32_t p) const {
+        return params[p];
+    }
+    
+    // nullptr for kNoIndex
+    const Expr* expr(uint32_t e) const {
+        return e == kNoIndex ? nullptr : &exprs[e];
+    }
+    
+    uint32_t arg(uint32_t k) const {
+        return args[k];
+    }
+    
+    std::string_view string(uint32_t s) const {
+        return std::string_view(bytes + strings[s].offset, strings[s].length);
+    }
+};
+
+// Expression access for records in a mapped AstImage
+struct ImageExpressions {
+    using Node = const AstImage::Expr*;
+    
+    const AstImage* image;
+    
+    static NodeKind kind(Node e) { return static_cast<NodeKind>(e->kind); }
+    static int line(Node e) { return e->line; }
+    Node left(Node e) const { return image->expr(e->a); }
+    Node right(Node e) const { return image->expr(e->b); }
+    std::string_view binary_op(Node e) const { return image->string(e->c); }
+    Node operand(Node e) const { return image->expr(e->a); }
+    std::string_view unary_op(Node e) const { return image->string(e->c); }
+    std::string_view name(Node e) const { return image->string(e->a); }
+    std::string_view callee(Node e) const { return image->string(e->a); }
+    static size_t arg_count(Node e) { return e->c; }
+    Node arg(Node e, size_t i) const { return image->expr(image->arg(e->b + static_cast<uint32_t>(i))); }
+    static int64_t int_value(Node e) { return e->integer; }
+    static double float_value(Node e) { return e->real; }
+    static bool bool_value(Node e) { return e->integer != 0; }
+};
+
+// Runtime registry of lint-style passes driven by one analyzer walk.
+// Callbacks fire in traversal order while the analyzer's scopes are
+// current, so a pass shares its scope state instead of keeping its own
+// and repeating lookups. Symbols are only guaranteed valid during the
+// callback: locals may be released once their function is done.
+class PassManager {
+public:
+    using DeclarationFn = std::function<void(const Symbol& symbol, size_t depth)>;
+    using ScopeFn = std::function<void(size_t depth)>;
+    using UseFn = std::function<void(const Symbol& symbol, const void* use, int line)>;
+    
+    void on_declaration(DeclarationFn fn) {
+        declarations.push_back(std::move(fn));
+    }
+    
+    void on_scope_enter(ScopeFn fn) {
+        scope_enters.push_back(std::move(fn));
+    }
+    
+    // Fires before the scope's bindings are dropped, so they still resolve
+    void on_scope_exit(ScopeFn fn) {
+        scope_exits.push_back(std::move(fn));
+    }
+    
+    // Identifier and callee resolutions; unresolved names are not reported
+    void on_use(UseFn fn) {
+        uses.push_back(std::move(fn));
+    }
+    
+    void declared(const Symbol& symbol, size_t depth) const {
+        for (const auto& fn : declarations) fn(symbol, depth);
+    }
+    
+    void scope_entered(size_t depth) const {
+        for (const auto& fn : scope_enters) fn(depth);
+    }
+    
+    void scope_exiting(size_t depth) const {
+        for (const auto& fn : scope_exits) fn(depth);
+    }
+    
+    void used(const Symbol& symbol, const void* use, int line) const {
+        for (const auto& fn : uses) fn(symbol, use, line);
+    }
+    
+private:
+    std::vector<DeclarationFn> declarations;
+    std::vector<ScopeFn> scope_enters;
+    std::vector<ScopeFn> scope_exits;
+    std::vector<UseFn> uses;
+};
+
+enum class MemoryCategory : uint8_t {
+    Symbols,     // Interner, symbol table and arena, flat name map
+    Scopes,      // Bindings and the scope stack
+    Diagnostics, // Diagnostic records; rendered text is not counted
+    Types,       // Compound type table
+    Caches,      // Inferred expression types and the reference index, both droppable
+    Imports,     // Import list and symbols materialized from SymbolImages
+    Traversal,   // Work and expression stacks, slot bitsets, folding
+    Count
+};
+
+// Live-byte accounting for one analyzer, layered over the caller's memory
+// resource: each category gets a forwarding resource that counts what is
+// outstanding through it. Counters are relaxed atomics, so they can be
+// read from another thread while an analysis runs.
+class MemoryTracker {
+    class CategoryResource : public std::pmr::memory_resource {
+    public:
+        MemoryTracker* owner = nullptr;
+        std::atomic<size_t> live{0};
+        
+    private:
+        void* do_allocate(size_t bytes, size_t align) override {
+            void* p = owner->upstream->allocate(bytes, align);
+            live.fetch_add(bytes, std::memory_order_relaxed);
+            owner->grew(bytes);
+            return p;
+        }
+        
+        void do_deallocate(void* p, size_t bytes, size_t align) override {
+            owner->upstream->deallocate(p, bytes, align);
+            live.fetch_sub(bytes, std::memory_order_relaxed);
+            owner->total.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+        
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+    
+    static constexpr size_t kCategoryCount = static_cast<size_t>(MemoryCategory::Count);
+    
+    std::pmr::memory_resource* upstream;
+    std::array<CategoryResource, kCategoryCount> categories;
+    std::atomic<size_t> total{0};
+    std::atomic<size_t> peak{0};
+    size_t budget_bytes = 0;
+    
+    void grew(size_t bytes) {
+        size_t now = total.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        size_t high = peak.load(std::memory_order_relaxed);
+        while (now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {}
+    }
+    
+public:
+    explicit MemoryTracker(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream(upstream) {
+        for (auto& category : categories) category.owner = this;
+    }
+    
+    // Resources hand out pointers to themselves
+    MemoryTracker(const MemoryTracker&) = delete;
+    MemoryTracker& operator=(const MemoryTracker&) = delete;
+    
+    std::pmr::memory_resource* resource(MemoryCategory category) {
+        return &categories[static_cast<size_t>(category)];
+    }
+    
+    size_t live_bytes(MemoryCategory category) const {
+        return categories[static_cast<size_t>(category)].live.load(std::memory_order_relaxed);
+    }
+    
+    size_t live_bytes() const {
+        return total.load(std::memory_order_relaxed);
+    }
+    
+    // High-water mark of live_bytes() since construction or reset_peak()
+    size_t peak_bytes() const {
+        return peak.load(std::memory_order_relaxed);
+    }
+    
+    void reset_peak() {
+        peak.store(live_bytes(), std::memory_order_relaxed);
+    }
+    
+    // 0 means unlimited
+    void set_budget(size_t bytes) {
+        budget_bytes = bytes;
+    }
+    
+    size_t budget() const {
+        return budget_bytes;
+    }
+    
+    bool over_budget() const {
+        return budget_bytes != 0 && live_bytes() > budget_bytes;
+    }
+};
+
+// Read-only hash table of a module's top-level symbols, filled once by the
+// signature pre-pass and never written again. find() touches nothing
+// mutable, so any number of threads can resolve globals without locking
+// and regardless of where in the module they were declared. The Symbols
+// stay owned by the analyzer that declared them, which must outlive the
+// table.
+class GlobalTable {
+    struct Slot {
+        uint64_t hash = 0;
+        const Symbol* symbol = nullptr;
+    };
+    
+    std::vector<Slot> slots; // Open addressing, nullptr marks an empty slot
+    size_t count = 0;
+    
+    size_t probe(std::string_view name, uint64_t h) const {
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        while (slots[i].symbol && !(slots[i].hash == h && NameKernel::equal(slots[i].symbol->name, name))) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+    
+public:
+    GlobalTable() = default;
+    
+    // A later symbol replaces an earlier one of the same name, the way a
+    // redeclaration shadows it in scope
+    explicit GlobalTable(const std::vector<const Symbol*>& symbols) {
+        size_t size = 16;
+        while (size < symbols.size() * 2) size *= 2;
+        slots.resize(size);
+        for (const Symbol* sym : symbols) {
+            uint64_t h = NameKernel::hash(sym->name);
+            Slot& slot = slots[probe(sym->name, h)];
+            if (!slot.symbol) ++count;
+            slot = Slot{h, sym};
+        }
+    }
+    
+    const Symbol* find(std::string_view name) const {
+        if (slots.empty()) return nullptr;
+        return slots[probe(name, NameKernel::hash(name))].symbol;
+    }
+    
+    size_t size() const {
+        return count;
+    }
+};
+
+class SemanticAnalyzer {
+    MemoryTracker tracker; // First, so every member below can allocate through it
+    std::pmr::vector<uint32_t> symbol_table;  // SymbolId -> innermost binding
+    std::pmr::vector<uint32_t> symbol_epochs; // SymbolId -> unit its symbol_table entry belongs to
+    uint32_t epoch = 0;                  // Bumped per unit, invalidating every entry at once
+    std::pmr::vector<Binding> bindings;       // Doubles as the undo log, innermost scope last
+    std::pmr::vector<uint32_t> scope_stack;   // First binding of each open scope
+    StringInterner interner;
+    Arena symbol_arena;
+    std::pmr::vector<SymbolId> flat_names;    // FlatAST string index -> interned ID
+    const GlobalTable* globals = nullptr;     // Pre-pass signatures in parallel and incremental mode
+    std::vector<std::string_view>* global_lookups = nullptr; // Names resolved against globals, if tracked
+    std::pmr::vector<const SymbolImage*> imports;  // Searched in order after every scope
+    mutable Arena import_arena;               // Symbols materialized from imports, kept across units
+    mutable std::pmr::unordered_map<std::string_view, const Symbol*> imported; // Keyed by the Symbol's own name
+    DiagnosticSink sink;
+    mutable std::vector<Diagnostic> rendered; // Text for sink.all()[0, size), filled in by diagnostics()
+    SEMANTIC_STAT(mutable AnalyzerStats stats;)
+    TypeTable type_table;
+    ExpressionTypeCache expression_types;
+    uint32_t scope_version = 1; // Bumped by scope_changed(); never ExpressionTypeCache::kAnyScope
+    TypeInfo current_return_type;
+    bool in_function = false;
+    
+    // Statements still to visit, innermost last. Function bodies push an
+    // ExitFunction marker below their statements, carrying the state to
+    // restore, so scope exits happen in order without native recursion.
+    struct WorkItem {
+        enum Op : uint8_t { VisitNode, VisitFlatNode, VisitImageNode, ExitFunction };
+        
+        Op op;
+        bool saved_in_function;
+        TypeInfo saved_return_type;
+        const ASTNode* node;
+        uint32_t flat_index;
+    };
+    
+    std::pmr::vector<WorkItem> work_stack;
+    std::pmr::vector<std::pair<const void*, bool>> expression_stack; // Node, children pushed
+    const FlatAST* flat_ast = nullptr;  // Tree being walked by the flat visitor
+    const AstImage* ast_image = nullptr; // Image being walked in place
+    
+    // Definite-initialization and use tracking. Each function body takes
+    // the slots from its frame base up; nested bodies stack above it.
+    SlotBitset initialized_slots;
+    SlotBitset used_slots;
+    std::pmr::vector<std::pair<SymbolId, const Symbol*>> slot_symbols; // Slot -> local, for reporting
+    std::pmr::vector<uint32_t> slot_frames;  // First slot of each open function body
+    std::pmr::vector<ConstantValue> fold_values; // Operand values while folding, innermost last
+    // Top-level nodes registered by declare_ahead() and not fed yet, with
+    // their function symbols; nullptr for global declarations
+    std::pmr::unordered_map<const ASTNode*, const Symbol*> declared_ahead;
+    ReferenceIndex reference_index;
+    bool tracking_references = false;
+    bool references_requested = false; // What track_references() asked for; the budget may override it per unit
+    std::vector<std::unique_ptr<SemanticAnalyzer>> batch_workers; // Kept warm across analyze_batch and analyze_module calls
+    std::pmr::memory_resource* resource;
+    
+    // Statement handlers, one per NodeKind, generated at compile time for
+    // the passes being run; see analyze_with()
+    using Handler = void (SemanticAnalyzer::*)(const ASTNode*);
+    using FlatHandler = void (SemanticAnalyzer::*)(const FlatAST&, uint32_t);
+    using ImageHandler = void (SemanticAnalyzer::*)(uint32_t);
+    const Handler* handlers = handler_table<>();
+    void* active_passes = nullptr; // std::tuple<Passes&...> matching handlers
+    const PassManager* pass_manager = nullptr;
+    std::optional<CancellationToken> cancellation;
+    bool memory_degraded = false;
+    
+    // Layout-independent view of a declaration, so that the tree and flat
+    // visitors share one set of checks
+    template <typename Layout>
+    struct DeclarationView {
+        SymbolId id;
+        std::string_view name;
+        std::optional<std::string_view> type_annotation;
+        Layout exprs;
+        typename Layout::Node initializer;
+        int line;
+    };
+    
+public:
+    // Every table, stack and arena block the analyzer owns is allocated
+    // from resource, which must outlive the analyzer, and counted by
+    // memory(). Batch workers share resource, so it has to be thread-safe
+    // when analyze_batch is given a pool; each worker counts its own bytes.
+    explicit SemanticAnalyzer(const DiagnosticOptions& options = {},
+                              std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : tracker(resource),
+          symbol_table(tracker.resource(MemoryCategory::Symbols)),
+          symbol_epochs(tracker.resource(MemoryCategory::Symbols)),
+          bindings(tracker.resource(MemoryCategory::Scopes)),
+          scope_stack(tracker.resource(MemoryCategory::Scopes)),
+          interner(tracker.resource(MemoryCategory::Symbols)),
+          symbol_arena(64 * 1024, tracker.resource(MemoryCategory::Symbols)),
+          flat_names(tracker.resource(MemoryCategory::Symbols)),
+          imports(tracker.resource(MemoryCategory::Imports)),
+          import_arena(64 * 1024, tracker.resource(MemoryCategory::Imports)),
+          imported(tracker.resource(MemoryCategory::Imports)),
+          sink(options, tracker.resource(MemoryCategory::Diagnostics)),
+          type_table(tracker.resource(MemoryCategory::Types)),
+          expression_types(tracker.resource(MemoryCategory::Caches)),
+          work_stack(tracker.resource(MemoryCategory::Traversal)),
+          expression_stack(tracker.resource(MemoryCategory::Traversal)),
+          initialized_slots(tracker.resource(MemoryCategory::Traversal)),
+          used_slots(tracker.resource(MemoryCategory::Traversal)),
+          slot_symbols(tracker.resource(MemoryCategory::Traversal)),
+          slot_frames(tracker.resource(MemoryCategory::Traversal)),
+          fold_values(tracker.resource(MemoryCategory::Traversal)),
+          declared_ahead(tracker.resource(MemoryCategory::Symbols)),
+          reference_index(tracker.resource(MemoryCategory::Caches)),
+          resource(resource) {
+        work_stack.reserve(256);
+        expression_stack.reserve(256);
+        SEMANTIC_STAT(sink.stats = &stats;)
+
+        enter_scope();
+        
+
+    }
+    
+    std::pmr::memory_resource* memory_resource() const {
+        return resource;
+    }
+    
+    // Live and peak bytes held by this analyzer, by category
+    const MemoryTracker& memory() const {
+        return tracker;
+    }
+    
+    void reset_peak_memory() {
+        tracker.reset_peak();
+    }
+    
+    // Caps live bytes, 0 for no cap. The cap is checked between top-level
+    // nodes and whenever a function scope opens or closes. Once over it,
+    // the analyzer drops the reference index (and stops recording
+    // references until the next begin_unit()), the inferred expression
+    // types and the cache of imported symbols, all of which are rebuilt or
+    // re-read on demand. If that is not enough the walk throws
+    // MemoryBudgetExceeded, which leaves the analyzer as a SemanticError
+    // would.
+    void set_memory_budget(size_t bytes) {
+        tracker.set_budget(bytes);
+    }
+    
+    // Whether the budget forced anything to be dropped since begin_unit()
+    bool degraded_by_memory_budget() const {
+        return memory_degraded;
+    }
+    
+    void analyze(const ASTNode* root) {
+        expression_types.clear();
+        visit(root);
+    }
+    
+    // Runs extra analyses in the same walk as the checks. A pass provides
+    // operator()(SemanticAnalyzer&, const XNode*) for the node classes it
+    // wants; it is called once per statement of that class, after the
+    // node's own checks and with the scopes as they stand at that point
+    // (for a function, before its body is walked). Overloads are picked at
+    // compile time, so kinds no pass handles cost nothing extra. Only tree
+    // walks can run passes: a FlatAST or AstImage walk started while they
+    // are installed throws std::logic_error.
+    template <typename... Passes>
+    void analyze_with(const ASTNode* root, Passes&... passes) {
+        std::tuple<Passes&...> state(passes...);
+        const Handler* saved_handlers = handlers;
+        void* saved_passes = active_passes;
+        handlers = handler_table<Passes...>();
+        active_passes = &state;
+        try {
+            visit(root);
+        } catch (...) {
+            handlers = saved_handlers;
+            active_passes = saved_passes;
+            throw;
+        }
+        handlers = saved_handlers;
+        active_passes = saved_passes;
+    }
+    
+    // Drives manager's callbacks from every walk of this analyzer, tree or
+    // flat, until detached with nullptr. Batch and parallel workers do not
+    // inherit it.
+    void use_passes(const PassManager* manager) {
+        pass_manager = manager;
+    }
+    
+    // Makes every later walk throw AnalysisCancelled at its next check once
+    // token is cancelled, until clear_cancellation()
+    void set_cancellation(const CancellationToken& token) {
+        cancellation = token;
+    }
+    
+    void clear_cancellation() {
+        cancellation.reset();
+    }
+    
+    struct AsyncResult {
+        std::vector<Diagnostic> diagnostics; // Everything delivered, in order
+        size_t completed = 0;                // Top-level nodes fully analyzed
+        bool cancelled = false;
+    };
+    
+    // Called with a top-level node's index and the diagnostics it produced
+    using PartialResult = std::function<void(size_t index, const std::vector<Diagnostic>& diagnostics)>;
+    
+    // Analyzes the top-level nodes of one unit on a new thread: a
+    // declare_ahead() pre-pass, so that forward references resolve as in
+    // analyze_parallel, then each node through feed(). on_partial runs on that thread after each node,
+    // so results can be shown as functions finish. Cancelling token stops
+    // the run at its next check; the future then holds what was delivered
+    // so far. In throwing mode the run ends at the first error, which is
+    // delivered last. The analyzer must not be used until the future is
+    // ready.
+    std::future<AsyncResult> analyze_async(std::vector<std::shared_ptr<ASTNode>> top_level,
+                                           const CancellationToken& token, PartialResult on_partial = {}) {
+        return std::async(std::launch::async,
+                          [this, top_level = std::move(top_level), token, on_partial = std::move(on_partial)] {
+                              return run_async(top_level, token, on_partial);
+                          });
+    }
+    
+    // Innermost symbol visible under name at this point of the walk, for
+    // passes run by analyze_with() or a PassManager
+    const Symbol* resolve(std::string_view name) const {
+        return find_symbol(name);
+    }
+    
+    void analyze(const std::shared_ptr<ASTNode>& root) {
+        analyze(root.get());
+    }
+    
+    // analyze_with() passes take tree nodes, which neither layout has, so
+    // a pass walking one of these is refused rather than silently skipped;
+    // a PassManager works on every layout
+    void analyze(const FlatAST& ast) {
+        reject_typed_passes("a FlatAST");
+        if (ast.size() == 0) return;
+        expression_types.clear();
+        flat_names.assign(ast.strings.size(), kNoSymbol);
+        flat_ast = &ast;
+        
+        size_t base = work_stack.size();
+        work_stack.push_back(WorkItem{WorkItem::VisitFlatNode, false, TypeInfo{}, nullptr, 0});
+        run_work_stack(base);
+        flat_ast = nullptr;
+    }
+    
+    // Walks the mapped image in place; nothing is copied out of it, so
+    // names and use sites in diagnostics and references point into the
+    // mapping and stay valid while the image is open
+    void analyze(const AstImage& image) {
+        reject_typed_passes("an AST image");
+        if (image.size() == 0) return;
+        expression_types.clear();
+        flat_names.assign(image.string_count(), kNoSymbol);
+        ast_image = &image;
+        
+        size_t base = work_stack.size();
+        work_stack.push_back(WorkItem{WorkItem::VisitImageNode, false, TypeInfo{}, nullptr, 0});
+        run_work_stack(base);
+        ast_image = nullptr;
+    }
+    
+    // Push-style analysis of one unit, for producers that emit top-level
+    // nodes one at a time. Each fed function is checked as soon as it
+    // arrives, and the analyzer keeps nothing that points into it, so the
+    // caller may free the subtree once feed() returns. Locals are released
+    // at the end of each function; only top-level symbols are retained.
+    // A body only sees the top-level names fed before it, unless
+    // declare_ahead() registered the unit's signatures first.
+    void begin_unit() {
+        reset_scopes();
+        // An analysis that threw may have left any of these mid-walk
+        work_stack.clear();
+        expression_stack.clear();
+        slot_symbols.clear();
+        slot_frames.clear();
+        fold_values.clear();
+        declared_ahead.clear();
+        flat_ast = nullptr;
+        ast_image = nullptr;
+        expression_types.clear();
+        symbol_arena.reset();
+        reference_index.clear();
+        clear_diagnostics();
+        memory_degraded = false;
+        tracking_references = references_requested;
+        in_function = false;
+        current_return_type = TypeInfo{};
+        
+        enter_scope();
+    }
+    
+    // Signature pre-pass for push-style analysis, the same as phase one of
+    // analyze_parallel: registers every top-level function signature and
+    // global declaration in top_level at once, so that bodies fed later
+    // resolve names declared after them. Call after begin_unit(), then
+    // feed the same nodes; they are not registered twice.
+    void declare_ahead(const std::vector<std::shared_ptr<ASTNode>>& top_level) {
+        for (const auto& node : top_level) {
+            if (!node) continue;
+            if (node->kind == NodeKind::Function) {
+                declared_ahead[node.get()] = declare_function(static_cast<const FunctionNode*>(node.get()));
+            } else {
+                visit(node.get());
+                declared_ahead[node.get()] = nullptr;
+            }
+        }
+    }
+    
+    void feed(const ASTNode* node) {
+        if (!node || sink.limit_reached()) return;
+        
+        // Entries for the previous node may alias freed addresses
+        expression_types.clear();
+        const Symbol* func_sym = nullptr;
+        auto ahead = declared_ahead.find(node);
+        if (ahead != declared_ahead.end()) {
+            func_sym = ahead->second;
+            declared_ahead.erase(ahead);
+            if (node->kind != NodeKind::Function) return;
+        } else if (node->kind != NodeKind::Function) {
+            visit(node);
+            return;
+        }
+        
+        auto func = static_cast<const FunctionNode*>(node);
+        if (!func_sym) func_sym = declare_function(func);
+        Arena::Mark body_start = symbol_arena.mark();
+        try {
+            size_t base = work_stack.size();
+            push_function_body(func, func_sym->type_info);
+            run_work_stack(base);
+        } catch (...) {
+            reset_function_state();
+            if (!tracking_references) symbol_arena.rewind(body_start);
+            throw;
+        }
+        
+        // The reference index points at the locals, so they stay for the unit
+        if (!tracking_references) symbol_arena.rewind(body_start);
+    }
+    
+    void feed(const std::shared_ptr<ASTNode>& node) {
+        feed(node.get());
+    }
+    
+    // Diagnostics for the unit, in reporting order
+    std::vector<Diagnostic> end_unit() {
+        while (scope_stack.size() > 1) exit_scope();
+        return take_diagnostics();
+    }
+    
+    // Analyzes each root as its own unit and returns their diagnostics in
+    // the same order. Interned names, the type table and all scope storage
+    // carry over from unit to unit, so after the first few units nothing
+    // is allocated beyond what the diagnostics need. In throwing mode a
+    // unit stops at its first error, which becomes its last diagnostic.
+    std::vector<std::vector<Diagnostic>> analyze_batch(const std::vector<std::shared_ptr<ASTNode>>& roots) {
+        std::vector<std::vector<Diagnostic>> results(roots.size());
+        for (size_t i = 0; i < roots.size(); ++i) {
+            results[i] = analyze_unit(roots[i].get());
+        }
+        return results;
+    }
+    
+    // Same, fanned out over the pool. Each worker keeps its own analyzer,
+    // created on first use and kept warm for later batches, and runs with
+    // this analyzer's imports, reference tracking, memory budget (applied
+    // to each worker's own bytes) and cancellation token.
+    std::vector<std::vector<Diagnostic>> analyze_batch(const std::vector<std::shared_ptr<ASTNode>>& roots,
+                                                       ThreadPool& pool) {
+        std::vector<std::unique_ptr<SemanticAnalyzer>>& workers = workers_for(pool);
+        
+        struct Failure {
+            std::exception_ptr error;
+            size_t index = SIZE_MAX;
+        };
+        std::vector<Failure> failures(pool.size());
+        std::vector<std::vector<Diagnostic>> results(roots.size());
+        
+        pool.parallel_for(roots.size(), [&](unsigned w, size_t i) {
+            try {
+                results[i] = workers[w]->analyze_unit(roots[i].get());
+            } catch (...) {
+                if (i < failures[w].index) {
+                    failures[w].error = std::current_exception();
+                    failures[w].index = i;
+                }
+            }
+        });
+        
+        // Rethrow what a serial batch would have hit first
+        const Failure* first = nullptr;
+        for (const auto& f : failures) {
+            if (f.error && (!first || f.index < first->index)) first = &f;
+        }
+        if (first) std::rethrow_exception(first->error);
+        return results;
+    }
+    
+    // Writes the symbols bound in the global scope, i.e. the unit's
+    // top-level functions and declarations, to a SymbolImage at path
+    void export_symbols(const std::string& path) const {
+        uint32_t end = scope_stack.size() > 1 ? scope_stack[1] : static_cast<uint32_t>(bindings.size());
+        std::vector<const Symbol*> symbols;
+        symbols.reserve(end);
+        for (uint32_t b = 0; b < end; ++b) symbols.push_back(bindings[b].symbol);
+        SymbolImage::write(path, symbols);
+    }
+    
+    // Makes image's symbols visible beneath the global scope. The image
+    // must outlive the analyzer; later imports are searched last.
+    void import_symbols(const SymbolImage& image) {
+        imports.push_back(&image);
+        scope_changed();
+    }
+    
+#ifdef SEMANTIC_INSTRUMENT
+    // Counters accumulated since construction, across every unit
+    const AnalyzerStats& instrumentation() const {
+        return stats;
+    }
+    
+    std::string instrumentation_json() const {
+        return stats.to_json();
+    }
+#endif
+    
+    // Records every name resolution from now on. The index lives until the
+    // next begin_unit(). Symbols stay valid for that long, even in
+    // streaming mode, where locals are then kept for the whole unit. Use
+    // nodes are only keys: query by node only while the node is alive.
+    void track_references(bool enabled) {
+        references_requested = enabled;
+        tracking_references = enabled;
+    }
+    
+    const ReferenceIndex& references() const {
+        return reference_index;
+    }
+    
+    // Folded value of the constant name resolves to, nullptr if it is not
+    // a constant or its initializer could not be evaluated
+    const ConstantValue* constant_value(std::string_view name) const {
+        const Symbol* sym = find_symbol(name);
+        return sym && sym->value.kind != ConstantValue::None ? &sym->value : nullptr;
+    }
+    
+    // Diagnostics recorded so far; in throwing mode only warnings. Text
+    // is rendered on first request.
+    const std::vector<Diagnostic>& diagnostics() const {
+        const auto& records = sink.all();
+        rendered.reserve(records.size());
+        for (size_t i = rendered.size(); i < records.size(); ++i) {
+            rendered.push_back(Diagnostic{records[i].line, render(records[i]), records[i].code,
+                                          severity_of(records[i].code)});
+        }
+        return rendered;
+    }
+    
+    // The same diagnostics as compact records, for consumers that filter
+    // or group them before anything is shown
+    const std::pmr::vector<DiagnosticRecord>& diagnostic_records() const {
+        return sink.all();
+    }
+    
+    std::string render(const DiagnosticRecord& record) const {
+        std::string name = record.name == kNoSymbol ? std::string() : std::string(interner.name(record.name));
+        switch (record.code) {
+            case DiagnosticCode::DuplicateFunction: return "Duplicate function name '" + name + "'";
+            case DiagnosticCode::DuplicateParameter: return "Duplicate parameter name '" + name + "'";
+            case DiagnosticCode::DuplicateVariable: return "Duplicate variable name '" + name + "'";
+            case DiagnosticCode::DuplicateConstant: return "Duplicate constant name '" + name + "'";
+            case DiagnosticCode::LetTypeMismatch: return "Type mismatch in let declaration";
+            case DiagnosticCode::VarTypeMismatch: return "Type mismatch in var declaration";
+            case DiagnosticCode::ConstTypeMismatch: return "Type mismatch in const declaration";
+            case DiagnosticCode::VarRequiresInitializer: return "var declaration requires initializer";
+            case DiagnosticCode::ConstRequiresInitializer: return "const declaration requires initializer";
+            case DiagnosticCode::UndefinedName: return "Undefined name '" + name + "'";
+            case DiagnosticCode::FunctionUsedAsValue: return "Function '" + name + "' used as a value";
+            case DiagnosticCode::UnknownBinaryOperator: return "Unknown binary operator '" + name + "'";
+            case DiagnosticCode::InvalidBinaryOperands: return "Invalid operand types for '" + name + "'";
+            case DiagnosticCode::UnknownUnaryOperator: return "Unknown unary operator '" + name + "'";
+            case DiagnosticCode::InvalidUnaryOperand: return "Invalid operand type for '" + name + "'";
+            case DiagnosticCode::UndefinedFunction: return "Call to undefined function '" + name + "'";
+            case DiagnosticCode::NotAFunction: return "'" + name + "' is not a function";
+            case DiagnosticCode::ArgumentCount:
+                return "Function '" + name + "' expects " + std::to_string(record.counts[0]) +
+                       " arguments, got " + std::to_string(record.counts[1]);
+            case DiagnosticCode::ArgumentType:
+                return "Argument " + std::to_string(record.counts[0] + 1) + " of call to '" + name +
+                       "' has the wrong type";
+            case DiagnosticCode::UnknownType: return "Unknown type: " + name;
+            case DiagnosticCode::UninitializedUse: return "Variable '" + name + "' used before initialization";
+            case DiagnosticCode::UnusedVariable: return "Unused variable '" + name + "'";
+            case DiagnosticCode::UnusedConstant: return "Unused constant '" + name + "'";
+            case DiagnosticCode::ConstantOverflow: return "Overflow in constant expression";
+            case DiagnosticCode::DivisionByZero: return "Division by zero in constant expression";
+            case DiagnosticCode::ConstantOutOfRange: return "Value of constant '" + name + "' is out of range for its type";
+            case DiagnosticCode::Count: break;
+        }
+        return "Unknown diagnostic";
+    }
+    
+    // Snapshot of the global scope's visible symbols, for checking bodies
+    // against on other threads. Nothing more may be declared at global
+    // scope while the table is in use, and this analyzer must outlive it.
+    GlobalTable freeze_globals() const {
+        size_t end = scope_stack.size() > 1 ? scope_stack[1] : bindings.size();
+        std::vector<const Symbol*> symbols;
+        symbols.reserve(end);
+        for (size_t i = 0; i < end; ++i) symbols.push_back(bindings[i].symbol);
+        return GlobalTable(symbols);
+    }
+    
+    // Type inferred for an expression by the last analyze() or feed(),
+    // nullptr if it was not checked there
+    const TypeInfo* expression_type(const ExpressionNode* expr) const {
+        return expression_types.find(expr);
+    }
+    
+    // Two-phase analysis of a module's top-level nodes as one unit of this
+    // analyzer. Phase one registers every function signature and global
+    // declaration here, in one scope, which is then frozen; phase two
+    // checks function bodies on the pool, each worker with its own scope
+    // stack. Workers come from the same set analyze_batch() keeps warm, so
+    // repeated calls allocate little beyond the diagnostics they return.
+    // These are ordered by line, then source order, and cut at the error
+    // limit. In throwing mode the first error in source order is thrown
+    // once every body has been checked, as a serial run with
+    // declare_ahead() would have stopped there.
+    std::vector<Diagnostic> analyze_module(const std::vector<std::shared_ptr<ASTNode>>& top_level, ThreadPool& pool) {
+        begin_unit();
+        IndexedDiagnostics errors;
+        std::vector<size_t> functions = collect_globals(*this, top_level, errors);
+        const GlobalTable table = freeze_globals();
+        
+        // Each worker's records stay in its sink until the end; a span
+        // marks where each function's records start
+        struct WorkerRun {
+            std::vector<std::pair<size_t, size_t>> spans; // Top-level index, first record
+            std::exception_ptr failure;
+            size_t failure_index = SIZE_MAX;
+        };
+        std::vector<WorkerRun> runs(pool.size());
+        std::vector<std::unique_ptr<SemanticAnalyzer>>& workers = workers_for(pool);
+        for (unsigned w = 0; w < pool.size(); ++w) {
+            workers[w]->begin_unit();
+            workers[w]->globals = &table;
+        }
+        
+        // The error limit applies per function here, which is enough to
+        // make the merged, truncated result independent of scheduling
+        pool.parallel_for(functions.size(), [&](unsigned w, size_t k) {
+            SemanticAnalyzer& worker = *workers[w];
+            WorkerRun& run = runs[w];
+            size_t index = functions[k];
+            run.spans.emplace_back(index, worker.sink.all().size());
+            worker.sink.restart_limit();
+            try {
+                worker.analyze_function_body(static_cast<const FunctionNode*>(top_level[index].get()));
+            } catch (...) {
+                if (index < run.failure_index) {
+                    run.failure = std::current_exception();
+                    run.failure_index = index;
+                }
+                worker.reset_function_state();
+            }
+        });
+        
+        const WorkerRun* failed = nullptr;
+        for (unsigned w = 0; w < pool.size(); ++w) {
+            SemanticAnalyzer& worker = *workers[w];
+            worker.globals = nullptr;
+            const WorkerRun& run = runs[w];
+            if (run.failure && (!failed || run.failure_index < failed->failure_index)) failed = &run;
+            
+            const auto& records = worker.sink.all();
+            for (size_t s = 0; s < run.spans.size(); ++s) {
+                size_t last = s + 1 < run.spans.size() ? run.spans[s + 1].second : records.size();
+                for (size_t r = run.spans[s].second; r < last; ++r) {
+                    errors.emplace_back(run.spans[s].first, Diagnostic{records[r].line, worker.render(records[r]),
+                                                                       records[r].code, severity_of(records[r].code)});
+                }
+            }
+            worker.clear_diagnostics();
+        }
+        // Semantic errors in throwing mode, and anything else in either
+        // mode, propagate as they would serially
+        if (failed) std::rethrow_exception(failed->failure);
+        
+        return merge_diagnostics(errors, sink.settings().error_limit);
+    }
+    
+    // The same with a fresh analyzer, for one-off callers
+    static std::vector<Diagnostic> analyze_parallel(const std::vector<std::shared_ptr<ASTNode>>& top_level,
+                                                    ThreadPool& pool,
+                                                    const DiagnosticOptions& options = {}) {
+        SemanticAnalyzer analyzer(options);
+        return analyzer.analyze_module(top_level, pool);
+    }
+    
+    static std::vector<Diagnostic> analyze_parallel(const std::vector<std::shared_ptr<ASTNode>>& top_level,
+                                                    const DiagnosticOptions& options = {}) {
+        ThreadPool pool;
+        return analyze_parallel(top_level, pool, options);
+    }
+    
+private:
+    friend class IncrementalAnalyzer;
+    
+    // Diagnostics tagged with the index of the top-level node they came from
+    using IndexedDiagnostics = std::vector<std::pair<size_t, Diagnostic>>;
+    
+    // Records only mean something to the analyzer holding their names, so
+    // they are rendered on the way out of it
+    static void gather(IndexedDiagnostics& out, size_t index, SemanticAnalyzer& from) {
+        for (auto& d : from.take_diagnostics()) out.emplace_back(index, std::move(d));
+    }
+    
+    // One warm analyzer per pool thread, created on first use. Each call
+    // hands them this analyzer's imports, reference tracking, memory
+    // budget and cancellation token as they stand now.
+    std::vector<std::unique_ptr<SemanticAnalyzer>>& workers_for(const ThreadPool& pool) {
+        while (batch_workers.size() < pool.size()) {
+            batch_workers.push_back(std::make_unique<SemanticAnalyzer>(sink.settings(), resource));
+        }
+        for (const auto& worker : batch_workers) {
+            if (worker->imports != imports) {
+                worker->imports.assign(imports.begin(), imports.end());
+                worker->imported.clear();
+                worker->import_arena.reset();
+                worker->scope_changed();
+            }
+            worker->track_references(references_requested);
+            worker->tracker.set_budget(tracker.budget());
+            worker->cancellation = cancellation;
+        }
+        return batch_workers;
+    }
+    
+    std::vector<Diagnostic> take_diagnostics() {
+        diagnostics();
+        std::vector<Diagnostic> taken = std::move(rendered);
+        clear_diagnostics();
+        return taken;
+    }
+    
+    void clear_diagnostics() {
+        sink.clear();
+        rendered.clear();
+    }
+    
+    void report(DiagnosticCode code, int line, SymbolId name = kNoSymbol,
+                TypeInfo expected = {}, TypeInfo actual = {}, uint32_t first = 0, uint32_t second = 0) {
+        if (!sink.wants(code)) return;
+        sink.report(DiagnosticRecord{code, line, name, expected, actual, {first, second}},
+                    [this](const DiagnosticRecord& record) { return render(record); });
+    }
+    
+    // For names that need not be bound anywhere; they are interned only
+    // once the diagnostic is known to be kept
+    void report(DiagnosticCode code, int line, std::string_view name,
+                TypeInfo expected = {}, TypeInfo actual = {}, uint32_t first = 0, uint32_t second = 0) {
+        if (!sink.wants(code)) return;
+        report(code, line, interner.intern(name), expected, actual, first, second);
+    }
+    
+    // Phase one, the signature pre-pass: registers every top-level function
+    // signature and global declaration in global, ready for
+    // freeze_globals(). Returns the indices of the functions.
+    static std::vector<size_t> collect_globals(SemanticAnalyzer& global,
+                                               const std::vector<std::shared_ptr<ASTNode>>& top_level,
+                                               IndexedDiagnostics& errors) {
+        std::vector<size_t> functions;
+        for (size_t i = 0; i < top_level.size(); ++i) {
+            const ASTNode* node = top_level[i].get();
+            if (!node) continue;
+            if (node->kind == NodeKind::Function) {
+                global.declare_function(static_cast<const FunctionNode*>(node));
+                functions.push_back(i);
+            } else {
+                global.visit(node);
+            }
+            gather(errors, i, global);
+        }
+        return functions;
+    }
+    
+    static std::vector<Diagnostic> merge_diagnostics(IndexedDiagnostics& errors, size_t error_limit) {
+        // Stable, so errors within one function keep their reporting order
+        std::stable_sort(errors.begin(), errors.end(), [](const auto& a, const auto& b) {
+            if (a.second.line != b.second.line) return a.second.line < b.second.line;
+            return a.first < b.first;
+        });
+        // Cut after the error_limit-th error, as a serial run stops there
+        if (error_limit != 0) {
+            size_t seen = 0;
+            auto last = std::find_if(errors.begin(), errors.end(), [&](const auto& e) {
+                return e.second.severity == Severity::Error && ++seen == error_limit;
+            });
+            if (last != errors.end()) errors.erase(last + 1, errors.end());
+        }
+        
+        std::vector<Diagnostic> result;
+        result.reserve(errors.size());
+        for (auto& e : errors) result.push_back(std::move(e.second));
+        return result;
+    }
+    
+    void check_cancelled() const {
+        if (cancellation && cancellation->cancelled()) throw AnalysisCancelled();
+    }
+    
+    // Only called between statements, when nothing in flight points into
+    // the dropped state
+    void check_memory() {
+        if (!tracker.over_budget()) return;
+        
+        reference_index.release();
+        tracking_references = false;
+        expression_types.release();
+        imported.clear();
+        import_arena.reset();
+        memory_degraded = true;
+        if (tracker.over_budget()) throw MemoryBudgetExceeded(tracker.live_bytes(), tracker.budget());
+    }
+    
+    AsyncResult run_async(const std::vector<std::shared_ptr<ASTNode>>& top_level, const CancellationToken& token,
+                          const PartialResult& on_partial) {
+        AsyncResult result;
+        size_t delivered = 0;
+        size_t index = 0;
+        auto deliver = [&](const Diagnostic* thrown) {
+            const auto& all = diagnostics();
+            std::vector<Diagnostic> fresh(all.begin() + delivered, all.end());
+            delivered = all.size();
+            if (thrown) fresh.push_back(*thrown);
+            result.diagnostics.insert(result.diagnostics.end(), fresh.begin(), fresh.end());
+            if (on_partial) on_partial(index, fresh);
+        };
+        
+        cancellation = token;
+        begin_unit();
+        try {
+            // Pre-pass diagnostics are delivered with the first node's
+            declare_ahead(top_level);
+            for (; index < top_level.size(); ++index) {
+                check_cancelled();
+                check_memory();
+                feed(top_level[index]);
+                deliver(nullptr);
+                ++result.completed;
+            }
+        } catch (const SemanticError& e) {
+            reset_function_state();
+            Diagnostic error{e.line, e.what(), e.code, severity_of(e.code)};
+            deliver(&error);
+        } catch (const AnalysisCancelled&) {
+            reset_function_state();
+            result.cancelled = true;
+        } catch (...) {
+            cancellation.reset();
+            throw;
+        }
+        cancellation.reset();
+        end_unit();
+        return result;
+    }
+    
+    std::vector<Diagnostic> analyze_unit(const ASTNode* root) {
+        begin_unit();
+        try {
+            visit(root);
+        } catch (const SemanticError& e) {
+            reset_function_state();
+            std::vector<Diagnostic> warnings = take_diagnostics();
+            warnings.push_back(Diagnostic{e.line, e.what(), e.code, severity_of(e.code)});
+            return warnings;
+        }
+        return end_unit();
+    }
+    
+    // Called whenever a name may resolve differently from before, so that
+    // cached types of expressions naming it are not reused
+    void scope_changed() {
+        if (++scope_version == ExpressionTypeCache::kAnyScope) {
+            expression_types.clear();
+            scope_version = 1;
+        }
+    }
+    
+    void enter_scope() {
+        scope_changed();
+        scope_stack.push_back(static_cast<uint32_t>(bindings.size()));
+        SEMANTIC_STAT(++stats.scopes_entered;
+                      stats.max_scope_depth = std::max<uint64_t>(stats.max_scope_depth, scope_stack.size());)
+        if (pass_manager) pass_manager->scope_entered(scope_stack.size());
+    }
+    
+    // Drops every scope without visiting the bindings: symbol_table entries
+    // stamped with an older epoch read as unbound
+    void reset_scopes() {
+        scope_changed();
+        bindings.clear();
+        scope_stack.clear();
+        if (++epoch == 0) {
+            std::fill(symbol_epochs.begin(), symbol_epochs.end(), 0);
+            epoch = 1;
+        }
+    }
+    
+    uint32_t head_of(SymbolId id) const {
+        if (id >= symbol_table.size() || symbol_epochs[id] != epoch) return kNoBinding;
+        return symbol_table[id];
+    }
+    
+    void exit_scope() {
+        if (scope_stack.empty()) {
+            throw std::logic_error("Scope stack underflow");
+        }
+        if (pass_manager) pass_manager->scope_exiting(scope_stack.size());
+        scope_changed();
+        
+        // Unwind this scope's bindings, re-exposing whatever they shadowed
+        uint32_t first = scope_stack.back();
+        while (bindings.size() > first) {
+            const Binding& b = bindings.back();
+            symbol_table[b.id] = b.shadowed;
+            bindings.pop_back();
+        }
+        scope_stack.pop_back();
+        SEMANTIC_STAT(++stats.scopes_exited;)
+    }
+    
+    const Symbol* find_symbol(std::string_view name) const {
+        // A name that was never interned cannot be bound in any scope
+        return find_symbol(interner.find(name), name);
+    }
+    
+    const Symbol* find_symbol(SymbolId id, std::string_view name) const {
+        SEMANTIC_STAT(++stats.find_symbol_calls; ++stats.lookup_levels;)
+        if (Symbol* local = lookup(id)) return local;
+        SEMANTIC_STAT(stats.lookup_levels += (globals != nullptr) + !imports.empty();)
+        if (globals) {
+            // Misses are recorded too: a global appearing later changes the result
+            if (global_lookups) global_lookups->push_back(name);
+            if (const Symbol* global = globals->find(name)) return global;
+        }
+        return imports.empty() ? nullptr : find_import(name);
+    }
+    
+    // Imported symbols are materialized on first use and cached by name
+    const Symbol* find_import(std::string_view name) const {
+        auto cached = imported.find(name);
+        if (cached != imported.end()) return cached->second;
+        
+        for (const SymbolImage* image : imports) {
+            const SymbolImage::Record* rec = image->find(name);
+            if (!rec) continue;
+            
+            // The name points into the mapping, which outlives this analyzer
+            Symbol sym(image->name(*rec), static_cast<SymbolType>(rec->symbol_type), image->type(*rec),
+                       true, rec->line);
+            if (rec->param_count) {
+                TypeInfo* param_types = static_cast<TypeInfo*>(
+                    import_arena.allocate(sizeof(TypeInfo) * rec->param_count, alignof(TypeInfo)));
+                for (uint32_t p = 0; p < rec->param_count; ++p) {
+                    param_types[p] = image->param_type(*rec, p);
+                }
+                sym.param_types = param_types;
+                sym.param_count = rec->param_count;
+            }
+            if (sym.symbol_type == SymbolType::Constant) sym.value = image->value(*rec);
+            
+            const Symbol* stored = import_arena.create<Symbol>(sym);
+            imported.emplace(stored->name, stored);
+            return stored;
+        }
+        return nullptr;
+    }
+    
+    // Innermost binding of id in this analyzer's own scopes
+    Symbol* lookup(SymbolId id) const {
+        if (id == kNoSymbol) return nullptr;
+        
+        uint32_t head = head_of(id);
+        return head == kNoBinding ? nullptr : bindings[head].symbol;
+    }
+    
+    // Stamps id's symbol_table entry for the current unit and returns the
+    // binding it holds, kNoBinding if none. Declarations take the slot once
+    // up front and check for duplicates against it, so binding the symbol
+    // afterwards needs no second lookup.
+    uint32_t claim_slot(SymbolId id) {
+        if (id >= symbol_table.size()) {
+            symbol_table.resize(interner.size(), kNoBinding);
+            symbol_epochs.resize(interner.size(), 0);
+        }
+        if (symbol_epochs[id] != epoch) {
+            symbol_epochs[id] = epoch;
+            symbol_table[id] = kNoBinding;
+        }
+        return symbol_table[id];
+    }
+    
+    // Bindings at or above the scope's mark belong to the innermost scope
+    bool in_current_scope(uint32_t head) const {
+        return head != kNoBinding && head >= scope_stack.back();
+    }
+    
+    // Constructs the symbol in place in the arena; id's slot must have been
+    // claimed. Names are taken from the interner, so nothing is copied.
+    template <typename... Args>
+    Symbol* declare(SymbolId id, Args&&... args) {
+        scope_changed();
+        uint32_t& head = symbol_table[id];
+        Symbol* stored = symbol_arena.create<Symbol>(interner.name(id), std::forward<Args>(args)...);
+        bindings.push_back(Binding{stored, id, head});
+        head = static_cast<uint32_t>(bindings.size() - 1);
+        if (pass_manager) pass_manager->declared(*stored, scope_stack.size());
+        return stored;
+    }
+    
+    void visit(const ASTNode* node) {
+        if (!node) return;
+        
+        size_t base = work_stack.size();
+        push_visit(node);
+        run_work_stack(base);
+    }
+    
+    void push_visit(const ASTNode* node) {
+        work_stack.push_back(WorkItem{WorkItem::VisitNode, false, TypeInfo{}, node, 0});
+    }
+    
+    // Drains everything pushed above base. Once the error limit is hit the
+    // remaining statements are dropped, but open scopes are still closed.
+    void run_work_stack(size_t base) {
+        while (work_stack.size() > base) {
+            WorkItem item = work_stack.back();
+            work_stack.pop_back();
+            
+            switch (item.op) {
+                case WorkItem::ExitFunction:
+                    end_function(item.saved_in_function, item.saved_return_type);
+                    check_cancelled();
+                    check_memory();
+                    break;
+                case WorkItem::VisitNode:
+                    if (!sink.limit_reached()) {
+                        SEMANTIC_STAT(VisitTimer timer(stats, item.node->kind);)
+                        dispatch(item.node);
+                    }
+                    break;
+                case WorkItem::VisitFlatNode:
+                    if (!sink.limit_reached()) {
+                        SEMANTIC_STAT(VisitTimer timer(stats, flat_ast->kinds[item.flat_index]);)
+                        dispatch_flat(*flat_ast, item.flat_index);
+                    }
+                    break;
+                case WorkItem::VisitImageNode:
+                    if (!sink.limit_reached()) {
+                        SEMANTIC_STAT(VisitTimer timer(stats, static_cast<NodeKind>(ast_image->node(item.flat_index).kind));)
+                        dispatch_image(item.flat_index);
+                    }
+                    break;
+            }
+        }
+    }
+    
+    void reject_typed_passes(const char* layout) const {
+        if (active_passes) {
+            throw std::logic_error(std::string("analyze_with() passes cannot walk ") + layout + "; use a PassManager");
+        }
+    }
+    
+    void dispatch(const ASTNode* node) {
+        Handler handler = handlers[static_cast<size_t>(node->kind)];
+        (this->*handler)(node);
+    }
+    
+    static constexpr bool is_expression_kind(NodeKind kind) {
+        return kind >= NodeKind::IntegerLiteral && kind <= NodeKind::CallExpression;
+    }
+    
+    // The analyzer's own checks for one statement kind
+    template <NodeKind K>
+    void check_node(const ASTNode* node) {
+        auto typed = static_cast<const typename NodeClass<K>::type*>(node);
+        if constexpr (K == NodeKind::Function) {
+            visit_function(typed);
+        } else if constexpr (K == NodeKind::LetDeclaration) {
+            visit_let_decl(typed);
+        } else if constexpr (K == NodeKind::VarDeclaration) {
+            visit_var_decl(typed);
+        } else if constexpr (K == NodeKind::ConstDeclaration) {
+            visit_const_decl(typed);
+        } else if constexpr (is_expression_kind(K)) {
+            // Expression statement
+            visit_expression(typed);
+        } else {
+            // Parameters are only reached through their function
+            static_assert(K == NodeKind::Parameter, "NodeKind without a statement handler");
+        }
+    }
+    
+    template <NodeKind K, typename... Passes>
+    void handle(const ASTNode* node) {
+        check_node<K>(node);
+        if constexpr (sizeof...(Passes) > 0) {
+            using Node = typename NodeClass<K>::type;
+            auto typed = static_cast<const Node*>(node);
+            auto& passes = *static_cast<std::tuple<Passes&...>*>(active_passes);
+            std::apply([&](auto&... pass) {
+                auto run = [&](auto& p) {
+                    if constexpr (std::is_invocable_v<decltype(p), SemanticAnalyzer&, const Node*>) p(*this, typed);
+                };
+                (run(pass), ...);
+            }, passes);
+        }
+    }
+    
+    template <typename... Passes, size_t... K>
+    static constexpr std::array<Handler, kNodeKindCount> make_handlers(std::index_sequence<K...>) {
+        return {{&SemanticAnalyzer::handle<static_cast<NodeKind>(K), Passes...>...}};
+    }
+    
+    template <typename... Passes>
+    static const Handler* handler_table() {
+        static constexpr std::array<Handler, kNodeKindCount> table =
+            make_handlers<Passes...>(std::make_index_sequence<kNodeKindCount>{});
+        return table.data();
+    }
+    
+    SymbolId flat_symbol(const FlatAST& ast, uint32_t name) {
+        SymbolId& id = flat_names[name];
+        if (id == kNoSymbol) id = interner.intern(ast.strings.name(name));
+        return id;
+    }
+    
+    void dispatch_flat(const FlatAST& ast, uint32_t node) {
+        FlatHandler handler = flat_handler_table()[static_cast<size_t>(ast.kinds[node])];
+        (this->*handler)(ast, node);
+    }
+    
+    // Other statement kinds are carried opaquely, see FlatAST
+    template <NodeKind K>
+    void check_flat(const FlatAST& ast, uint32_t node) {
+        if constexpr (K == NodeKind::Function) {
+            visit_flat_function(ast, node);
+        } else if constexpr (K == NodeKind::LetDeclaration) {
+            visit_let_decl(flat_decl_view(ast, node));
+        } else if constexpr (K == NodeKind::VarDeclaration) {
+            visit_var_decl(flat_decl_view(ast, node));
+        } else if constexpr (K == NodeKind::ConstDeclaration) {
+            visit_const_decl(flat_decl_view(ast, node));
+        } else if constexpr (is_expression_kind(K)) {
+            visit_expression(static_cast<const ExpressionNode*>(ast.opaque_nodes[ast.operands[node]].get()));
+        }
+    }
+    
+    template <size_t... K>
+    static constexpr std::array<FlatHandler, kNodeKindCount> make_flat_handlers(std::index_sequence<K...>) {
+        return {{&SemanticAnalyzer::check_flat<static_cast<NodeKind>(K)>...}};
+    }
+    
+    static const FlatHandler* flat_handler_table() {
+        static constexpr std::array<FlatHandler, kNodeKindCount> table =
+            make_flat_handlers(std::make_index_sequence<kNodeKindCount>{});
+        return table.data();
+    }
+    
+    void visit_flat_function(const FlatAST& ast, uint32_t func) {
+        uint32_t name = ast.names[func];
+        uint32_t first_param = ast.param_begin[func];
+        const Symbol* func_sym = declare_function(
+            flat_symbol(ast, name), ast.strings.name(name), ast.strings.name(ast.types[func]), ast.lines[func],
+            ast.param_end[func] - first_param,
+            [&](size_t i) -> std::string_view { return ast.strings.name(ast.param_types[first_param + i]); });
+        begin_function(func_sym->type_info);
+        
+        for (uint32_t p = ast.param_begin[func]; p < ast.param_end[func]; ++p) {
+            uint32_t param = ast.param_names[p];
+            visit_parameter(flat_symbol(ast, param), ast.strings.name(ast.param_types[p]), ast.param_lines[p]);
+        }
+        
+        // The body is one contiguous slice; pushed in reverse so that it
+        // is still visited front to back
+        for (uint32_t stmt = ast.child_end[func]; stmt-- > ast.child_begin[func];) {
+            work_stack.push_back(WorkItem{WorkItem::VisitFlatNode, false, TypeInfo{}, nullptr, stmt});
+        }
+    }
+    
+    DeclarationView<TreeExpressions> flat_decl_view(const FlatAST& ast, uint32_t decl) {
+        uint32_t name = ast.names[decl];
+        uint32_t type = ast.types[decl];
+        uint32_t init = ast.operands[decl];
+        return DeclarationView<TreeExpressions>{
+            flat_symbol(ast, name),
+            ast.strings.name(name),
+            type == kNoIndex ? std::nullopt : std::optional<std::string_view>(ast.strings.name(type)),
+            TreeExpressions{},
+            init == kNoIndex ? nullptr : ast.expressions[init].get(),
+            ast.lines[decl]
+        };
+    }
+    
+    SymbolId image_symbol(uint32_t name) {
+        SymbolId& id = flat_names[name];
+        if (id == kNoSymbol) id = interner.intern(ast_image->string(name));
+        return id;
+    }
+    
+    void dispatch_image(uint32_t node) {
+        ImageHandler handler = image_handler_table()[ast_image->node(node).kind];
+        (this->*handler)(node);
+    }
+    
+    template <NodeKind K>
+    void check_image(uint32_t node) {
+        const AstImage::Node& n = ast_image->node(node);
+        if constexpr (K == NodeKind::Function) {
+            visit_image_function(node);
+        } else if constexpr (K == NodeKind::LetDeclaration) {
+            visit_let_decl(image_decl_view(n));
+        } else if constexpr (K == NodeKind::VarDeclaration) {
+            visit_var_decl(image_decl_view(n));
+        } else if constexpr (K == NodeKind::ConstDeclaration) {
+            visit_const_decl(image_decl_view(n));
+        } else if constexpr (is_expression_kind(K)) {
+            if (n.operand != kNoIndex) visit_expression(ImageExpressions{ast_image}, ast_image->expr(n.operand));
+        }
+    }
+    
+    template <size_t... K>
+    static constexpr std::array<ImageHandler, kNodeKindCount> make_image_handlers(std::index_sequence<K...>) {
+        return {{&SemanticAnalyzer::check_image<static_cast<NodeKind>(K)>...}};
+    }
+    
+    static const ImageHandler* image_handler_table() {
+        static constexpr std::array<ImageHandler, kNodeKindCount> table =
+            make_image_handlers(std::make_index_sequence<kNodeKindCount>{});
+        return table.data();
+    }
+    
+    void visit_image_function(uint32_t func) {
+        const AstImage& image = *ast_image;
+        const AstImage::Node& n = image.node(func);
+        const Symbol* func_sym = declare_function(
+            image_symbol(n.name), image.string(n.name), image.string(n.type), n.line, n.param_end - n.param_begin,
+            [&](size_t i) -> std::string_view {
+                return image.string(image.param(n.param_begin + static_cast<uint32_t>(i)).type);
+            });
+        begin_function(func_sym->type_info);
+        
+        for (uint32_t p = n.param_begin; p < n.param_end; ++p) {
+            const AstImage::Param& param = image.param(p);
+            visit_parameter(image_symbol(param.name), image.string(param.type), param.line);
+        }
+        for (uint32_t stmt = n.child_end; stmt-- > n.child_begin;) {
+            work_stack.push_back(WorkItem{WorkItem::VisitImageNode, false, TypeInfo{}, nullptr, stmt});
+        }
+    }
+    
+    DeclarationView<ImageExpressions> image_decl_view(const AstImage::Node& decl) {
+        return DeclarationView<ImageExpressions>{
+            image_symbol(decl.name),
+            ast_image->string(decl.name),
+            decl.type == kNoIndex ? std::nullopt : std::optional<std::string_view>(ast_image->string(decl.type)),
+            ImageExpressions{ast_image},
+            ast_image->expr(decl.operand),
+            decl.line
+        };
     }
     
-    void exit_scope() {
-        if (scope_stack.empty()) {
-            throw std::logic_error("Scope stack underflow");
-        }
-        scope_stack.pop_back();
+    void visit_function(const FunctionNode* func) {
+        const Symbol* func_sym = declare_function(func);
+        push_function_body(func, func_sym->type_info);
     }
     
-    Symbol* find_symbol(const std::string& name) {
-        for (auto it = scope_stack.rbegin(); it != scope_stack.rend(); ++it) {
-            auto found = it->find(name);
-            if (found != it->end()) {
-                return &found->second;
-            }
-        }
-        return nullptr;
+    void analyze_function_body(const FunctionNode* func) {
+        // An unknown return type was already reported with the signature
+        expression_types.clear();
+        size_t base = work_stack.size();
+        push_function_body(func, lookup_type_name(func->return_type).value_or(TypeInfo{}));
+        run_work_stack(base);
     }
     
-    void visit(std::shared_ptr<ASTNode> node) {
-        if (!node) return;
+    // Opens the body scope and binds the parameters now; the statements are
+    // left on the work stack above the marker that closes the scope
+    void push_function_body(const FunctionNode* func, const TypeInfo& return_type) {
+        begin_function(return_type);
         
-        switch (node->kind) {
-            case NodeKind::Function: {
-                visit_function(std::static_pointer_cast<FunctionNode>(node));
-                break;
-            }
-            case NodeKind::LetDeclaration: {
-                visit_let_decl(std::static_pointer_cast<LetDeclarationNode>(node));
-                break;
-            }
-            case NodeKind::VarDeclaration: {
-                visit_var_decl(std::static_pointer_cast<VarDeclarationNode>(node));
-                break;
-            }
-            case NodeKind::ConstDeclaration: {
-                visit_const_decl(std::static_pointer_cast<ConstDeclarationNode>(node));
-                break;
-            }
+        // Add parameters to scope
+        for (const auto& param : func->parameters) {
+            visit_parameter(param.get());
+        }
         
+        // Visit all statements in function body, in order
+        for (auto it = func->body.rbegin(); it != func->body.rend(); ++it) {
+            if (*it) push_visit(it->get());
         }
     }
     
-    void visit_function(std::shared_ptr<FunctionNode> func) {
+    const Symbol* declare_function(const FunctionNode* func) {
+        return declare_function(interner.intern(func->name), func->name, func->return_type, func->line,
+                                func->parameters.size(),
+                                [&](size_t i) -> std::string_view { return func->parameters[i]->type; });
+    }
+    
+    template <typename ParamTypeAt>
+    const Symbol* declare_function(SymbolId id, std::string_view name, std::string_view return_type, int line,
+                                   size_t param_count, ParamTypeAt param_type_at) {
  
-        if (find_symbol(func->name)) {
-            throw SemanticError("Duplicate function name '" + func->name + "'", func->line);
+        if (find_symbol(id, name)) {
+            report(DiagnosticCode::DuplicateFunction, line, id);
+        }
+        claim_slot(id);
+        TypeInfo type_info = parse_type(return_type, line);
+        
+        // Unknown parameter types are reported when the parameter itself is
+        // visited, so the signature just records them as Unknown
+        TypeInfo* params = static_cast<TypeInfo*>(symbol_arena.allocate(sizeof(TypeInfo) * param_count, alignof(TypeInfo)));
+        for (size_t i = 0; i < param_count; ++i) {
+            params[i] = lookup_type_name(param_type_at(i)).value_or(TypeInfo{});
         }
         
         // Add function to symbol table
-        Symbol func_sym;
-        func_sym.name = func->name;
-        func_sym.symbol_type = SymbolType::Function;
-        func_sym.type_info = parse_type(func->return_type);
-        func_sym.is_initialized = true;
-        func_sym.declaration_line = func->line;
-        scope_stack.back()[func->name] = func_sym;
+        return declare(id, SymbolType::Function, type_info, true, line, params, static_cast<uint32_t>(param_count));
+    }
+    
+    void begin_function(const TypeInfo& return_type) {
+        check_cancelled();
+        check_memory();
+        
+        // Closing the body restores the enclosing function's state
+        work_stack.push_back(WorkItem{WorkItem::ExitFunction, in_function, current_return_type, nullptr, 0});
         
         // Process function body
         in_function = true;
-        current_return_type = func_sym.type_info;
+        current_return_type = return_type;
+        slot_frames.push_back(static_cast<uint32_t>(slot_symbols.size()));
         enter_scope();
+    }
+    
+    void end_function(bool saved_in_function, const TypeInfo& saved_return_type) {
+        report_unused_locals();
+        exit_scope();
+        in_function = saved_in_function;
+        current_return_type = saved_return_type;
+    }
+    
+    // Gives a local declared in a function body the next dataflow slot
+    void assign_slot(SymbolId id, Symbol* sym) {
+        if (slot_frames.empty()) return;
         
-        // Add parameters to scope
-        for (const auto& param : func->parameters) {
-            visit_parameter(param);
-        }
-        
-        // Visit all statements in function body
-        for (const auto& stmt : func->body) {
-            visit(stmt);
+        sym->slot = static_cast<uint32_t>(slot_symbols.size());
+        slot_symbols.emplace_back(id, sym);
+        initialized_slots.ensure(slot_symbols.size());
+        used_slots.ensure(slot_symbols.size());
+        if (sym->is_initialized) {
+            initialized_slots.set(sym->slot);
+        } else {
+            initialized_slots.reset(sym->slot);
         }
-        
-        exit_scope();
+        used_slots.reset(sym->slot);
+    }
+    
+    // Locals of the closing body whose use bit was never set, in
+    // declaration order; their slots are then released
+    void report_unused_locals() {
+        uint32_t base = slot_frames.back();
+        slot_frames.pop_back();
+        used_slots.for_each_clear(base, slot_symbols.size(), [&](size_t slot) {
+            const auto& local = slot_symbols[slot];
+            report(local.second->symbol_type == SymbolType::Constant ? DiagnosticCode::UnusedConstant
+                                                                     : DiagnosticCode::UnusedVariable,
+                   local.second->declaration_line, local.first);
+        });
+        slot_symbols.resize(base);
+    }
+    
+    // Drops the scopes and pending work an aborted function body left behind
+    void reset_function_state() {
+        while (scope_stack.size() > 1) exit_scope();
+        work_stack.clear();
+        expression_stack.clear();
+        slot_symbols.clear();
+        slot_frames.clear();
         in_function = false;
     }
     
-    void visit_parameter(std::shared_ptr<ParameterNode> param) {
-        Symbol sym;
-        sym.name = param->name;
-        sym.symbol_type = SymbolType::Variable;
-        sym.type_info = parse_type(param->type);
-        sym.is_initialized = true; 
-        sym.declaration_line = param->line;
+    void visit_parameter(const ParameterNode* param) {
+        visit_parameter(interner.intern(param->name), param->type, param->line);
+    }
+    
+    void visit_parameter(SymbolId id, std::string_view type, int line) {
+        TypeInfo type_info = parse_type(type, line);
         
-
-        if (scope_stack.back().count(param->name)) {
-            throw SemanticError("Duplicate parameter name '" + param->name + "'", param->line);
+        if (in_current_scope(claim_slot(id))) {
+            report(DiagnosticCode::DuplicateParameter, line, id);
         }
         
-        scope_stack.back()[param->name] = sym;
+        declare(id, SymbolType::Variable, type_info, true, line);
     }
     
-    void visit_let_decl(std::shared_ptr<LetDeclarationNode> let_decl) {
-        Symbol sym;
-        sym.name = let_decl->name;
-        sym.symbol_type = SymbolType::Variable;
-        sym.declaration_line = let_decl->line;
-        
+    template <typename Decl>
+    DeclarationView<TreeExpressions> view_of(const Decl* decl) {
+        return DeclarationView<TreeExpressions>{
+            interner.intern(decl->name),
+            decl->name,
+            decl->type_annotation ? std::optional<std::string_view>(*decl->type_annotation) : std::nullopt,
+            TreeExpressions{},
+            decl->initializer.get(),
+            decl->line
+        };
+    }
+    
+    void visit_let_decl(const LetDeclarationNode* let_decl) {
+        visit_let_decl(view_of(let_decl));
+    }
+    
+    void visit_var_decl(const VarDeclarationNode* var_decl) {
+        visit_var_decl(view_of(var_decl));
+    }
+    
+    void visit_const_decl(const ConstDeclarationNode* const_decl) {
+        visit_const_decl(view_of(const_decl));
+    }
+    
+    template <typename Layout>
+    void visit_let_decl(const DeclarationView<Layout>& let_decl) {
         // Check for duplicate name in current scope
-        if (scope_stack.back().count(let_decl->name)) {
-            throw SemanticError("Duplicate variable name '" + let_decl->name + "'", let_decl->line);
+        SymbolId id = let_decl.id;
+        if (in_current_scope(claim_slot(id))) {
+            report(DiagnosticCode::DuplicateVariable, let_decl.line, id);
         }
         
         // Handle type annotation
-        if (let_decl->type_annotation) {
-            sym.type_info = parse_type(let_decl->type_annotation);
-        } else {
-            sym.type_info.kind = TypeKind::Auto;
+        TypeInfo type_info{TypeKind::Auto, 0, false, false};
+        if (let_decl.type_annotation) {
+            type_info = parse_type(*let_decl.type_annotation, let_decl.line);
         }
         
         // Handle initialization
-        if (let_decl->initializer) {
-            TypeInfo init_type = visit_expression(let_decl->initializer);
+        bool is_initialized = false;
+        if (let_decl.initializer) {
+            TypeInfo init_type = visit_expression(let_decl.exprs, let_decl.initializer);
             
-            if (sym.type_info.kind == TypeKind::Auto) {
+            if (type_info.kind() == TypeKind::Auto) {
                 // Type inference
-                sym.type_info = init_type;
+                type_info = concrete_type(init_type);
             } else {
                 // Check type compatibility
-                if (!types_compatible(sym.type_info, init_type)) {
-                    throw SemanticError("Type mismatch in let declaration", let_decl->line);
+                if (!types_compatible(type_info, init_type)) {
+                    report(DiagnosticCode::LetTypeMismatch, let_decl.line, id, type_info, init_type);
                 }
             }
             
-            sym.is_initialized = true;
-        } else {
-            sym.is_initialized = false;
+            is_initialized = true;
         }
         
         // Immutable by default for let
-        sym.type_info.is_mutable = false;
-        
-        scope_stack.back()[let_decl->name] = sym;
+        assign_slot(id, declare(id, SymbolType::Variable, type_info.with_mutable(false), is_initialized, let_decl.line));
     }
     
-    void visit_var_decl(std::shared_ptr<VarDeclarationNode> var_decl) {
-        Symbol sym;
-        sym.name = var_decl->name;
-        sym.symbol_type = SymbolType::Variable;
-        sym.declaration_line = var_decl->line;
-        
+    template <typename Layout>
+    void visit_var_decl(const DeclarationView<Layout>& var_decl) {
         // Check for duplicate name in current scope
-        if (scope_stack.back().count(var_decl->name)) {
-            throw SemanticError("Duplicate variable name '" + var_decl->name + "'", var_decl->line);
+        SymbolId id = var_decl.id;
+        if (in_current_scope(claim_slot(id))) {
+            report(DiagnosticCode::DuplicateVariable, var_decl.line, id);
         }
         
         // Handle type annotation
-        if (var_decl->type_annotation) {
-            sym.type_info = parse_type(var_decl->type_annotation);
-        } else {
-            sym.type_info.kind = TypeKind::Auto;
+        TypeInfo type_info{TypeKind::Auto, 0, false, false};
+        if (var_decl.type_annotation) {
+            type_info = parse_type(*var_decl.type_annotation, var_decl.line);
         }
         
         // var declarations must have initializers
-        if (!var_decl->initializer) {
-            throw SemanticError("var declaration requires initializer", var_decl->line);
+        TypeInfo init_type{TypeKind::Unknown, 0, false, false};
+        if (var_decl.initializer) {
+            init_type = visit_expression(var_decl.exprs, var_decl.initializer);
+        } else {
+            report(DiagnosticCode::VarRequiresInitializer, var_decl.line, id);
         }
         
-        TypeInfo init_type = visit_expression(var_decl->initializer);
-        
-        if (sym.type_info.kind == TypeKind::Auto) {
-            sym.type_info = init_type;
+        if (type_info.kind() == TypeKind::Auto) {
+            type_info = concrete_type(init_type);
         } else {
-            if (!types_compatible(sym.type_info, init_type)) {
-                throw SemanticError("Type mismatch in var declaration", var_decl->line);
+            if (var_decl.initializer && !types_compatible(type_info, init_type)) {
+                report(DiagnosticCode::VarTypeMismatch, var_decl.line, id, type_info, init_type);
             }
         }
         
-        sym.is_initialized = true;
-        sym.type_info.is_mutable = true; // var is mutable
-        
-        scope_stack.back()[var_decl->name] = sym;
+        // var is mutable
+        assign_slot(id, declare(id, SymbolType::Variable, type_info.with_mutable(true), true, var_decl.line));
     }
     
-    void visit_const_decl(std::shared_ptr<ConstDeclarationNode> const_decl) {
-        Symbol sym;
-        sym.name = const_decl->name;
-        sym.symbol_type = SymbolType::Constant;
-        sym.declaration_line = const_decl->line;
-        
+    template <typename Layout>
+    void visit_const_decl(const DeclarationView<Layout>& const_decl) {
         // Check for duplicate name in current scope
-        if (scope_stack.back().count(const_decl->name)) {
-            throw SemanticError("Duplicate constant name '" + const_decl->name + "'", const_decl->line);
+        SymbolId id = const_decl.id;
+        if (in_current_scope(claim_slot(id))) {
+            report(DiagnosticCode::DuplicateConstant, const_decl.line, id);
         }
         
         // Handle type annotation
-        if (const_decl->type_annotation) {
-            sym.type_info = parse_type(const_decl->type_annotation);
-        } else {
-            sym.type_info.kind = TypeKind::Auto;
+        TypeInfo type_info{TypeKind::Auto, 0, false, false};
+        if (const_decl.type_annotation) {
+            type_info = parse_type(*const_decl.type_annotation, const_decl.line);
         }
         
         // const declarations must have initializers
-        if (!const_decl->initializer) {
-            throw SemanticError("const declaration requires initializer", const_decl->line);
+        TypeInfo init_type{TypeKind::Unknown, 0, false, false};
+        if (const_decl.initializer) {
+            init_type = visit_expression(const_decl.exprs, const_decl.initializer);
+        } else {
+            report(DiagnosticCode::ConstRequiresInitializer, const_decl.line, id);
         }
         
-        TypeInfo init_type = visit_expression(const_decl->initializer);
-        
-        if (sym.type_info.kind == TypeKind::Auto) {
+        if (type_info.kind() == TypeKind::Auto) {
             // Type inference
-            sym.type_info = init_type;
+            type_info = concrete_type(init_type);
         } else {
             // Check type compatibility
-            if (!types_compatible(sym.type_info, init_type)) {
-                throw SemanticError("Type mismatch in const declaration", const_decl->line);
+            if (const_decl.initializer && !types_compatible(type_info, init_type)) {
+                report(DiagnosticCode::ConstTypeMismatch, const_decl.line, id, type_info, init_type);
+                init_type = TypeInfo{};
             }
         }
         
-        sym.is_initialized = true;
-        sym.type_info.is_mutable = false; // const is immutable
+        ConstantValue value;
+        if (const_decl.initializer && init_type.kind() != TypeKind::Unknown && type_info.kind() != TypeKind::Unknown) {
+            value = fold_constant(const_decl.exprs, const_decl.initializer, type_info, id, const_decl.line);
+        }
         
-        scope_stack.back()[const_decl->name] = sym;
+        // const is immutable
+        Symbol* sym = declare(id, SymbolType::Constant, type_info.with_mutable(false), true, const_decl.line);
+        sym->value = value;
+        assign_slot(id, sym);
     }
     
-    TypeInfo visit_expression(std::shared_ptr<ExpressionNode> expr) {
-        // This would evaluate the expression and return its type
-        // Implementation depends on your expression hierarchy
-        return TypeInfo{TypeKind::Unknown, 0, false, false};
+    // Post-order walk on an explicit stack: a node is inferred only after
+    // all of its operands are in the type cache, so infer_expression never
+    // recurses and very deep expressions don't grow the native stack.
+    // Layout is TreeExpressions or ImageExpressions.
+    template <typename Layout>
+    TypeInfo visit_expression(const Layout& exprs, typename Layout::Node expr) {
+        if (!expr) return TypeInfo{};
+        if (const TypeInfo* cached = expression_types.find(expr, scope_version)) return *cached;
+        
+        size_t base = expression_stack.size();
+        expression_stack.emplace_back(expr, false);
+        while (expression_stack.size() > base) {
+            auto& top = expression_stack.back();
+            auto node = static_cast<typename Layout::Node>(top.first);
+            if (expression_types.find(node, scope_version)) {
+                expression_stack.pop_back();
+            } else if (!top.second) {
+                top.second = true;
+                push_operands(exprs, node);
+            } else {
+                expression_stack.pop_back();
+                TypeInfo type = infer_expression(exprs, node);
+                expression_types.insert(node, type, names_nothing(exprs, node) ? ExpressionTypeCache::kAnyScope
+                                                                               : scope_version);
+            }
+        }
+        return *expression_types.find(expr);
+    }
+    
+    // Whether node's type holds in any scope: it has no identifier or call
+    // under it. Its operands are already in the cache.
+    template <typename Layout>
+    bool names_nothing(const Layout& exprs, typename Layout::Node expr) const {
+        switch (exprs.kind(expr)) {
+            case NodeKind::IntegerLiteral:
+            case NodeKind::FloatLiteral:
+            case NodeKind::StringLiteral:
+            case NodeKind::BoolLiteral:
+                return true;
+            case NodeKind::BinaryExpression:
+                return expression_types.scope_independent(exprs.left(expr)) &&
+                       expression_types.scope_independent(exprs.right(expr));
+            case NodeKind::UnaryExpression:
+                return expression_types.scope_independent(exprs.operand(expr));
+            default:
+                return false;
+        }
+    }
+    
+    TypeInfo visit_expression(const ExpressionNode* expr) {
+        return visit_expression(TreeExpressions{}, expr);
+    }
+    
+    void push_operand(const void* operand) {
+        if (operand && !expression_types.find(operand, scope_version)) {
+            expression_stack.emplace_back(operand, false);
+        }
+    }
+    
+    // Pushed right to left so that operands are checked left to right
+    template <typename Layout>
+    void push_operands(const Layout& exprs, typename Layout::Node expr) {
+        switch (exprs.kind(expr)) {
+            case NodeKind::BinaryExpression:
+                push_operand(exprs.right(expr));
+                push_operand(exprs.left(expr));
+                break;
+            case NodeKind::UnaryExpression:
+                push_operand(exprs.operand(expr));
+                break;
+            case NodeKind::CallExpression:
+                for (size_t i = exprs.arg_count(expr); i-- > 0;) {
+                    push_operand(exprs.arg(expr, i));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // Unknown marks an operand that already produced a diagnostic; checks
+    // involving it stay quiet so that one mistake yields one error
+    template <typename Layout>
+    TypeInfo infer_expression(const Layout& exprs, typename Layout::Node expr) {
+        int line = exprs.line(expr);
+        switch (exprs.kind(expr)) {
+            case NodeKind::IntegerLiteral:
+                return kIntegerLiteralType;
+            case NodeKind::FloatLiteral:
+                return kFloatLiteralType;
+            case NodeKind::StringLiteral:
+                return TypeInfo{TypeKind::String, 0, false, false};
+            case NodeKind::BoolLiteral:
+                return TypeInfo{TypeKind::Bool, 0, false, false};
+            case NodeKind::Identifier: {
+                std::string_view name = exprs.name(expr);
+                const Symbol* sym = find_symbol(name);
+                if (!sym) {
+                    report(DiagnosticCode::UndefinedName, line, name);
+                    return TypeInfo{};
+                }
+                if (tracking_references) reference_index.add(expr, sym, line);
+                if (pass_manager) pass_manager->used(*sym, expr, line);
+                if (sym->symbol_type == SymbolType::Function) {
+                    report(DiagnosticCode::FunctionUsedAsValue, line, name);
+                    return TypeInfo{};
+                }
+                
+                bool initialized = sym->is_initialized;
+                if (sym->slot != kNoSlot) {
+                    used_slots.set(sym->slot);
+                    initialized = initialized_slots.test(sym->slot);
+                }
+                if (!initialized) {
+                    report(DiagnosticCode::UninitializedUse, line, name);
+                }
+                return sym->type_info.with_mutable(false);
+            }
+            case NodeKind::BinaryExpression: {
+                TypeInfo left = visit_expression(exprs, exprs.left(expr));
+                TypeInfo right = visit_expression(exprs, exprs.right(expr));
+                return binary_result(exprs.binary_op(expr), left, right, line);
+            }
+            case NodeKind::UnaryExpression: {
+                TypeInfo operand = visit_expression(exprs, exprs.operand(expr));
+                return unary_result(exprs.unary_op(expr), operand, line);
+            }
+            case NodeKind::CallExpression:
+                return call_result(exprs, expr);
+            default:
+                return TypeInfo{};
+        }
+    }
+    
+    // Integer and float literals have no width of their own and take on
+    // whichever width they meet; on their own they default to i32 and f64
+    static constexpr TypeInfo kIntegerLiteralType{TypeKind::Int, 0, false, false};
+    static constexpr TypeInfo kFloatLiteralType{TypeKind::Float, 0, false, false};
+    
+    static bool is_literal_type(const TypeInfo& type) {
+        return type == kIntegerLiteralType || type == kFloatLiteralType;
+    }
+    
+    static bool is_numeric(const TypeInfo& type) {
+        return type.kind() == TypeKind::Int || type.kind() == TypeKind::Float;
+    }
+    
+    static TypeInfo concrete_type(const TypeInfo& type) {
+        if (type == kIntegerLiteralType) return TypeInfo{TypeKind::Int, 32, true, false};
+        if (type == kFloatLiteralType) return TypeInfo{TypeKind::Float, 64, true, false};
+        return type;
+    }
+    
+    // Common type of two operands, or Unknown if they don't agree
+    static TypeInfo unify(const TypeInfo& a, const TypeInfo& b) {
+        if (a.kind() != b.kind()) return TypeInfo{};
+        if (a == b) return a;
+        if (is_literal_type(a)) return b;
+        if (is_literal_type(b)) return a;
+        return TypeInfo{};
+    }
+    
+    TypeInfo binary_result(std::string_view op, const TypeInfo& left, const TypeInfo& right, int line) {
+        if (left.kind() == TypeKind::Unknown || right.kind() == TypeKind::Unknown) return TypeInfo{};
+        
+        TypeInfo common = unify(left, right);
+        bool valid;
+        TypeInfo result = common;
+        if (op == "+") {
+            valid = is_numeric(common) || common.kind() == TypeKind::String;
+        } else if (op == "-" || op == "*" || op == "/") {
+            valid = is_numeric(common);
+        } else if (op == "%" || op == "&" || op == "|" || op == "^") {
+            valid = common.kind() == TypeKind::Int;
+        } else if (op == "<<" || op == ">>") {
+            // The shift amount may be any integer type
+            valid = left.kind() == TypeKind::Int && right.kind() == TypeKind::Int;
+            result = left;
+        } else if (op == "==" || op == "!=") {
+            valid = common.kind() != TypeKind::Unknown && common.kind() != TypeKind::Void;
+            result = TypeInfo{TypeKind::Bool, 0, false, false};
+        } else if (op == "<" || op == "<=" || op == ">" || op == ">=") {
+            valid = is_numeric(common) || common.kind() == TypeKind::String;
+            result = TypeInfo{TypeKind::Bool, 0, false, false};
+        } else if (op == "&&" || op == "||") {
+            valid = common.kind() == TypeKind::Bool;
+        } else {
+            report(DiagnosticCode::UnknownBinaryOperator, line, op);
+            return TypeInfo{};
+        }
+        
+        if (!valid) {
+            report(DiagnosticCode::InvalidBinaryOperands, line, op);
+            return TypeInfo{};
+        }
+        return result;
+    }
+    
+    // Evaluates an already type-checked initializer as target. Operands are
+    // evaluated in the types inferred for them: unsigned arithmetic wraps
+    // at the type's width, signed overflow and division by zero are errors.
+    // Untyped literal subexpressions work in 64 bits and are range-checked
+    // once they meet target. Anything not computable, such as calls,
+    // strings or non-constant names, leaves the value unfolded.
+    template <typename Layout>
+    ConstantValue fold_constant(const Layout& exprs, typename Layout::Node init, TypeInfo target, SymbolId id,
+                                int line) {
+        fold_values.clear();
+        size_t base = expression_stack.size();
+        expression_stack.emplace_back(init, false);
+        bool failed = false;
+        
+        while (expression_stack.size() > base) {
+            auto& top = expression_stack.back();
+            auto node = static_cast<typename Layout::Node>(top.first);
+            if (!top.second && !failed) {
+                top.second = true;
+                push_fold_operands(exprs, node);
+                continue;
+            }
+            expression_stack.pop_back();
+            if (failed) continue;
+            
+            ConstantValue v = fold_node(exprs, node);
+            if (v.kind == ConstantValue::None) {
+                // Errors were reported where they happened; give up on the rest
+                failed = true;
+                continue;
+            }
+            fold_values.push_back(v);
+        }
+        if (failed || fold_values.size() != 1) return ConstantValue{};
+        
+        ConstantValue value = fold_values.back();
+        const TypeInfo* init_type = expression_types.find(init);
+        if (value.kind == ConstantValue::Int &&
+            !fits(widen(value, init_type ? *init_type : TypeInfo{}), concrete_type(target))) {
+            report(DiagnosticCode::ConstantOutOfRange, line, id);
+            return ConstantValue{};
+        }
+        // Untyped float operands fold in double; the result is stored at
+        // the declared width
+        if (value.kind == ConstantValue::Float && target.kind() == TypeKind::Float) {
+            value = make_float(value.real, target);
+        }
+        return value;
+    }
+    
+    template <typename Layout>
+    void push_fold_operands(const Layout& exprs, typename Layout::Node expr) {
+        switch (exprs.kind(expr)) {
+            case NodeKind::BinaryExpression:
+                expression_stack.emplace_back(exprs.right(expr), false);
+                expression_stack.emplace_back(exprs.left(expr), false);
+                break;
+            case NodeKind::UnaryExpression:
+                expression_stack.emplace_back(exprs.operand(expr), false);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // Integer folding covers widths up to 64 bits; width 0 is an untyped
+    // literal, folded as i64
+    static bool foldable_int(const TypeInfo& type) {
+        return type.kind() == TypeKind::Int && type.width() <= 64;
+    }
+    
+    static bool fits(__int128 v, const TypeInfo& type) {
+        if (!foldable_int(type)) return false;
+        int width = type.width() ? type.width() : 64;
+        bool is_signed = type.width() ? type.is_signed() : true;
+        if (is_signed) {
+            __int128 limit = __int128(1) << (width - 1);
+            return v >= -limit && v < limit;
+        }
+        return v >= 0 && v < (__int128(1) << width);
+    }
+    
+    // Widened value of a folded integer, per its type's signedness
+    static __int128 widen(const ConstantValue& v, const TypeInfo& type) {
+        if (type.width() && !type.is_signed()) return static_cast<__int128>(static_cast<uint64_t>(v.integer));
+        return v.integer;
+    }
+    
+    static ConstantValue make_int(__int128 v) {
+        ConstantValue c;
+        c.kind = ConstantValue::Int;
+        c.integer = static_cast<int64_t>(static_cast<uint64_t>(v));
+        return c;
+    }
+    
+    static ConstantValue make_float(double v, const TypeInfo& type) {
+        ConstantValue c;
+        c.kind = ConstantValue::Float;
+        c.real = type.width() == 32 ? static_cast<double>(static_cast<float>(v)) : v;
+        return c;
+    }
+    
+    static ConstantValue make_bool(bool v) {
+        ConstantValue c;
+        c.kind = ConstantValue::Bool;
+        c.boolean = v;
+        return c;
+    }
+    
+    // Reduces r to type: unsigned results wrap, signed ones must fit
+    ConstantValue int_result(__int128 r, const TypeInfo& type, int line) {
+        if (type.width() && !type.is_signed()) {
+            unsigned __int128 mask = (static_cast<unsigned __int128>(1) << type.width()) - 1;
+            return make_int(static_cast<__int128>(static_cast<unsigned __int128>(r) & mask));
+        }
+        if (!fits(r, type)) {
+            report(DiagnosticCode::ConstantOverflow, line);
+            return ConstantValue{};
+        }
+        return make_int(r);
+    }
+    
+    template <typename Layout>
+    ConstantValue fold_node(const Layout& exprs, typename Layout::Node expr) {
+        const TypeInfo* cached = expression_types.find(expr);
+        TypeInfo type = cached ? *cached : TypeInfo{};
+        int line = exprs.line(expr);
+        
+        switch (exprs.kind(expr)) {
+            case NodeKind::IntegerLiteral:
+                return make_int(exprs.int_value(expr));
+            case NodeKind::FloatLiteral:
+                return make_float(exprs.float_value(expr), type);
+            case NodeKind::BoolLiteral:
+                return make_bool(exprs.bool_value(expr));
+            case NodeKind::Identifier: {
+                const Symbol* sym = find_symbol(exprs.name(expr));
+                return sym && sym->symbol_type == SymbolType::Constant ? sym->value : ConstantValue{};
+            }
+            case NodeKind::UnaryExpression: {
+                std::string_view op = exprs.unary_op(expr);
+                ConstantValue v = fold_values.back();
+                fold_values.pop_back();
+                
+                if (v.kind == ConstantValue::Bool && op == "!") return make_bool(!v.boolean);
+                if (v.kind == ConstantValue::Float && op == "-") return make_float(-v.real, type);
+                if (v.kind != ConstantValue::Int || !foldable_int(type)) return ConstantValue{};
+                if (op == "-") return int_result(-widen(v, type), type, line);
+                if (op == "~") return int_result(~widen(v, type), type, line);
+                return ConstantValue{};
+            }
+            case NodeKind::BinaryExpression: {
+                std::string_view op = exprs.binary_op(expr);
+                ConstantValue right = fold_values.back();
+                fold_values.pop_back();
+                ConstantValue left = fold_values.back();
+                fold_values.pop_back();
+                if (left.kind != right.kind && op != "<<" && op != ">>") return ConstantValue{};
+                
+                const TypeInfo* left_cached = expression_types.find(exprs.left(expr));
+                const TypeInfo* right_cached = expression_types.find(exprs.right(expr));
+                TypeInfo operand_type = left_cached && right_cached ? unify(*left_cached, *right_cached) : TypeInfo{};
+                return fold_binary(op, left, right, type, operand_type,
+                                   right_cached ? *right_cached : TypeInfo{}, line);
+            }
+            default:
+                return ConstantValue{};
+        }
+    }
+    
+    ConstantValue fold_binary(std::string_view op, const ConstantValue& left, const ConstantValue& right,
+                              const TypeInfo& type, const TypeInfo& operand_type, const TypeInfo& right_type,
+                              int line) {
+        if (left.kind == ConstantValue::Bool) {
+            if (op == "&&") return make_bool(left.boolean && right.boolean);
+            if (op == "||") return make_bool(left.boolean || right.boolean);
+            if (op == "==") return make_bool(left.boolean == right.boolean);
+            if (op == "!=") return make_bool(left.boolean != right.boolean);
+            return ConstantValue{};
+        }
+        
+        if (left.kind == ConstantValue::Float) {
+            double a = left.real;
+            double b = right.real;
+            if (op == "+") return make_float(a + b, type);
+            if (op == "-") return make_float(a - b, type);
+            if (op == "*") return make_float(a * b, type);
+            if (op == "/") return make_float(a / b, type);
+            if (op == "==") return make_bool(a == b);
+            if (op == "!=") return make_bool(a != b);
+            if (op == "<") return make_bool(a < b);
+            if (op == "<=") return make_bool(a <= b);
+            if (op == ">") return make_bool(a > b);
+            if (op == ">=") return make_bool(a >= b);
+            return ConstantValue{};
+        }
+        
+        if (left.kind != ConstantValue::Int) return ConstantValue{};
+        
+        if (op == "<<" || op == ">>") {
+            if (right.kind != ConstantValue::Int || !foldable_int(type)) return ConstantValue{};
+            __int128 a = widen(left, type);
+            __int128 amount = widen(right, right_type);
+            int width = type.width() ? type.width() : 64;
+            if (amount < 0 || amount >= width) {
+                report(DiagnosticCode::ConstantOverflow, line);
+                return ConstantValue{};
+            }
+            if (op == ">>") return int_result(a >> static_cast<int>(amount), type, line);
+            
+            // Shifting out set bits of a signed value is overflow; unsigned bits just fall off
+            if (type.width() && !type.is_signed()) {
+                return int_result(static_cast<__int128>(static_cast<unsigned __int128>(a) << static_cast<int>(amount)), type, line);
+            }
+            return int_result(a * (__int128(1) << static_cast<int>(amount)), type, line);
+        }
+        
+        if (!foldable_int(operand_type)) return ConstantValue{};
+        __int128 a = widen(left, operand_type);
+        __int128 b = widen(right, operand_type);
+        if (op == "==") return make_bool(a == b);
+        if (op == "!=") return make_bool(a != b);
+        if (op == "<") return make_bool(a < b);
+        if (op == "<=") return make_bool(a <= b);
+        if (op == ">") return make_bool(a > b);
+        if (op == ">=") return make_bool(a >= b);
+        
+        if (op == "+") return int_result(a + b, type, line);
+        if (op == "-") return int_result(a - b, type, line);
+        if (op == "*") return int_result(a * b, type, line);
+        if (op == "&") return int_result(a & b, type, line);
+        if (op == "|") return int_result(a | b, type, line);
+        if (op == "^") return int_result(a ^ b, type, line);
+        if (op == "/" || op == "%") {
+            if (b == 0) {
+                report(DiagnosticCode::DivisionByZero, line);
+                return ConstantValue{};
+            }
+            return int_result(op == "/" ? a / b : a % b, type, line);
+        }
+        return ConstantValue{};
+    }
+    
+    TypeInfo unary_result(std::string_view op, const TypeInfo& operand, int line) {
+        if (operand.kind() == TypeKind::Unknown) return TypeInfo{};
+        
+        bool valid;
+        if (op == "-") {
+            valid = is_numeric(operand);
+        } else if (op == "!") {
+            valid = operand.kind() == TypeKind::Bool;
+        } else if (op == "~") {
+            valid = operand.kind() == TypeKind::Int;
+        } else {
+            report(DiagnosticCode::UnknownUnaryOperator, line, op);
+            return TypeInfo{};
+        }
+        
+        if (!valid) {
+            report(DiagnosticCode::InvalidUnaryOperand, line, op);
+            return TypeInfo{};
+        }
+        return operand;
+    }
+    
+    template <typename Layout>
+    TypeInfo call_result(const Layout& exprs, typename Layout::Node call) {
+        // Arguments have already been checked by the time the callee is,
+        // so errors inside them surface even when the callee is bad
+        std::string_view name = exprs.callee(call);
+        int line = exprs.line(call);
+        size_t arg_count = exprs.arg_count(call);
+        const Symbol* callee = find_symbol(name);
+        if (callee && tracking_references) reference_index.add(call, callee, line);
+        if (callee && pass_manager) pass_manager->used(*callee, call, line);
+        if (!callee) {
+            report(DiagnosticCode::UndefinedFunction, line, name);
+        } else if (callee->symbol_type != SymbolType::Function) {
+            report(DiagnosticCode::NotAFunction, line, name);
+            callee = nullptr;
+        } else if (arg_count != callee->param_count) {
+            report(DiagnosticCode::ArgumentCount, line, name, TypeInfo{}, TypeInfo{},
+                   callee->param_count, static_cast<uint32_t>(arg_count));
+        }
+        
+        for (size_t i = 0; i < arg_count; ++i) {
+            TypeInfo arg = visit_expression(exprs, exprs.arg(call, i));
+            if (callee && i < callee->param_count && !types_compatible(callee->param_types[i], arg)) {
+                report(DiagnosticCode::ArgumentType, line, name, callee->param_types[i], arg, static_cast<uint32_t>(i));
+            }
+        }
+        return callee ? callee->type_info : TypeInfo{};
     }
     
-    TypeInfo parse_type(const std::string& type_name) {
-        if (type_name == "i8") return {TypeKind::Int, 8, true, false};
-        if (type_name == "u8") return {TypeKind::Int, 8, false, false};
-        if (type_name == "i16") return {TypeKind::Int, 16, true, false};
-        if (type_name == "u16") return {TypeKind::Int, 16, false, false};
-        if (type_name == "i32") return {TypeKind::Int, 32, true, false};
-        if (type_name == "u32") return {TypeKind::Int, 32, false, false};
-        if (type_name == "i64") return {TypeKind::Int, 64, true, false};
-        if (type_name == "u64") return {TypeKind::Int, 64, false, false};
-        if (type_name == "i128") return {TypeKind::Int, 128, true, false};
-        if (type_name == "u128") return {TypeKind::Int, 128, false, false};
-        if (type_name == "f32") return {TypeKind::Float, 32, true, false};
-        if (type_name == "f64") return {TypeKind::Float, 64, true, false};
-        if (type_name == "str") return {TypeKind::String, 0, false, false};
-        if (type_name == "string") return {TypeKind::String, 0, false, false};
-        if (type_name == "bool") return {TypeKind::Bool, 0, false, false};
-        if (type_name == "auto") return {TypeKind::Auto, 0, false, false};
+    TypeInfo parse_type(std::string_view type_name, int line) {
+        SEMANTIC_STAT(++stats.parse_type_hits[std::string(type_name)];)
+        if (auto type = lookup_type_name(type_name)) return *type;
         
-        throw std::runtime_error("Unknown type: " + type_name);
+        report(DiagnosticCode::UnknownType, line, type_name);
+        return TypeInfo{TypeKind::Unknown, 0, false, false};
     }
     
     bool types_compatible(const TypeInfo& expected, const TypeInfo& actual) {
-        // Simple type compatibility check
-        // Could be expanded for more complex cases
-        if (expected.kind == TypeKind::Auto) return true;
-        if (expected.kind != actual.kind) return false;
-        if (expected.kind == TypeKind::Int || expected.kind == TypeKind::Float) {
-            return expected.width == actual.width && 
-                   expected.is_signed == actual.is_signed;
+        // Handles are canonical, so kind, width and signedness (or the
+        // interned compound type) all compare in one go. Unknown on either
+        // side means an unknown type name or a failed initializer, which
+        // has been reported already.
+        if (expected.kind() == TypeKind::Auto || expected.kind() == TypeKind::Unknown ||
+            actual.kind() == TypeKind::Unknown) {
+            return true;
+        }
+        if (is_literal_type(actual)) return expected.kind() == actual.kind();
+        return expected == actual;
+    }
+};
+
+// Incremental driver for the language server. Each update() re-runs the
+// cheap signature phase over the whole module, then reuses the cached body
+// diagnostics of every function whose content hash is unchanged and whose
+// global dependencies still have the same signatures. Only the rest are
+// re-checked. Duplicate functions are caught by the signature phase, so
+// that check covers cached and recomputed functions alike. Body hashes
+// are kept per top-level node, so an update told which functions were
+// edited hashes only those bodies.
+class IncrementalAnalyzer {
+    struct Dependency {
+        std::string name;
+        uint64_t signature; // 0 when the name didn't resolve
+    };
+    
+    struct CachedFunction {
+        std::vector<Diagnostic> diagnostics; // Lines relative to the function's own line
+        std::vector<Dependency> dependencies;
+        uint64_t seen = 0;                   // Last update() that used the entry
+    };
+    
+    // FNV-1a over the fields fed to it
+    struct ContentHasher {
+        uint64_t h = 14695981039346656037ull;
+        
+        void add(uint64_t v) {
+            for (int i = 0; i < 8; ++i) {
+                h ^= (v >> (i * 8)) & 0xFF;
+                h *= 1099511628211ull;
+            }
+        }
+        
+        void add(std::string_view str) {
+            add(str.size());
+            for (unsigned char c : str) {
+                h ^= c;
+                h *= 1099511628211ull;
+            }
+        }
+    };
+    
+    // Body hash of a top-level function, kept while the same node is passed
+    // to update() and not reported edited
+    struct RootHash {
+        std::weak_ptr<ASTNode> node; // Tells the root from a later one at the same address
+        uint64_t body = 0;
+        uint64_t seen = 0;           // Last update() the root was part of
+    };
+    
+    DiagnosticOptions options;
+    std::unordered_map<uint64_t, CachedFunction> cache;       // Keyed by function content
+    std::unordered_map<const ASTNode*, RootHash> root_hashes;
+    uint64_t generation = 0;                                  // Counts update() calls
+    // One pair for every update: global holds the module's signatures,
+    // worker re-checks bodies against them
+    SemanticAnalyzer global;
+    SemanticAnalyzer worker;
+    std::vector<std::string_view> lookups;
+    size_t rechecked = 0;
+    
+    static DiagnosticOptions collecting(DiagnosticOptions options) {
+        options.throw_on_error = false;
+        return options;
+    }
+    
+    // Lines are hashed relative to base_line, the top-level function's, so
+    // that an edit above it doesn't invalidate it. Nodes are hashed in
+    // preorder from an explicit stack, so nesting depth is bounded by
+    // memory, not the native stack.
+    static void hash_nodes(ContentHasher& hasher, std::vector<const ASTNode*>& pending, int base_line) {
+        while (!pending.empty()) {
+            const ASTNode* node = pending.back();
+            pending.pop_back();
+            if (!node) {
+                hasher.add(UINT64_MAX);
+                continue;
+            }
+            hasher.add(static_cast<uint64_t>(node->kind));
+            hasher.add(static_cast<uint64_t>(node->line - base_line));
+            switch (node->kind) {
+                case NodeKind::Function: {
+                    auto nested = static_cast<const FunctionNode*>(node);
+                    hasher.add(nested->name);
+                    hasher.add(nested->return_type);
+                    hasher.add(nested->parameters.size());
+                    for (const auto& param : nested->parameters) {
+                        hasher.add(param->name);
+                        hasher.add(param->type);
+                        hasher.add(static_cast<uint64_t>(param->line - base_line));
+                    }
+                    hasher.add(nested->body.size());
+                    for (auto it = nested->body.rbegin(); it != nested->body.rend(); ++it) pending.push_back(it->get());
+                    break;
+                }
+                case NodeKind::LetDeclaration:
+                    hash_decl(hasher, static_cast<const LetDeclarationNode*>(node), pending);
+                    break;
+                case NodeKind::VarDeclaration:
+                    hash_decl(hasher, static_cast<const VarDeclarationNode*>(node), pending);
+                    break;
+                case NodeKind::ConstDeclaration:
+                    hash_decl(hasher, static_cast<const ConstDeclarationNode*>(node), pending);
+                    break;
+                case NodeKind::IntegerLiteral:
+                    hasher.add(static_cast<uint64_t>(static_cast<const IntegerLiteralNode*>(node)->value));
+                    break;
+                case NodeKind::FloatLiteral: {
+                    double value = static_cast<const FloatLiteralNode*>(node)->value;
+                    uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    hasher.add(bits);
+                    break;
+                }
+                case NodeKind::StringLiteral:
+                    hasher.add(static_cast<const StringLiteralNode*>(node)->value);
+                    break;
+                case NodeKind::BoolLiteral:
+                    hasher.add(static_cast<const BoolLiteralNode*>(node)->value ? 1 : 0);
+                    break;
+                case NodeKind::Identifier:
+                    hasher.add(static_cast<const IdentifierNode*>(node)->name);
+                    break;
+                case NodeKind::BinaryExpression: {
+                    auto binary = static_cast<const BinaryExpressionNode*>(node);
+                    hasher.add(binary->op);
+                    pending.push_back(binary->right.get());
+                    pending.push_back(binary->left.get());
+                    break;
+                }
+                case NodeKind::UnaryExpression: {
+                    auto unary = static_cast<const UnaryExpressionNode*>(node);
+                    hasher.add(unary->op);
+                    pending.push_back(unary->operand.get());
+                    break;
+                }
+                case NodeKind::CallExpression: {
+                    auto call = static_cast<const CallExpressionNode*>(node);
+                    hasher.add(call->callee);
+                    hasher.add(call->arguments.size());
+                    for (auto it = call->arguments.rbegin(); it != call->arguments.rend(); ++it) {
+                        pending.push_back(it->get());
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+    
+    // Name, return type and parameters; cheap enough to hash on every
+    // update, so signature edits made in place are always seen
+    static uint64_t signature_content(const FunctionNode* func) {
+        ContentHasher hasher;
+        hasher.add(func->name);
+        hasher.add(func->return_type);
+        hasher.add(func->parameters.size());
+        for (const auto& param : func->parameters) {
+            hasher.add(param->name);
+            hasher.add(param->type);
+            hasher.add(static_cast<uint64_t>(param->line - func->line));
+        }
+        return hasher.h;
+    }
+    
+    static uint64_t body_content(const FunctionNode* func) {
+        ContentHasher hasher;
+        hasher.add(func->body.size());
+        std::vector<const ASTNode*> pending;
+        pending.reserve(func->body.size());
+        for (auto it = func->body.rbegin(); it != func->body.rend(); ++it) pending.push_back(it->get());
+        hash_nodes(hasher, pending, func->line);
+        return hasher.h;
+    }
+    
+    // Content key of a top-level function. Unless rehash_all, the body is
+    // only hashed when the root is new to this analyzer or its entry was
+    // dropped as edited.
+    uint64_t function_key(const std::shared_ptr<ASTNode>& root, bool rehash_all) {
+        auto func = static_cast<const FunctionNode*>(root.get());
+        RootHash& entry = root_hashes[func];
+        if (rehash_all || entry.node.lock() != root) {
+            entry.node = root;
+            entry.body = body_content(func);
+        }
+        entry.seen = generation;
+        
+        ContentHasher hasher;
+        hasher.add(signature_content(func));
+        hasher.add(entry.body);
+        return hasher.h;
+    }
+    
+    // The initializer is left on pending, to be hashed next
+    template <typename Decl>
+    static void hash_decl(ContentHasher& hasher, const Decl* decl, std::vector<const ASTNode*>& pending) {
+        hasher.add(decl->name);
+        hasher.add(decl->type_annotation ? 1 : 0);
+        if (decl->type_annotation) hasher.add(std::string_view(*decl->type_annotation));
+        pending.push_back(decl->initializer.get());
+    }
+    
+    static uint64_t signature_hash(const Symbol* sym) {
+        if (!sym) return 0;
+        ContentHasher hasher;
+        hasher.add(static_cast<uint64_t>(sym->symbol_type));
+        hasher.add(sym->type_info.raw());
+        hasher.add(sym->param_count);
+        for (uint32_t i = 0; i < sym->param_count; ++i) {
+            hasher.add(sym->param_types[i].raw());
+        }
+        // Bodies fold global constants and check their initialization
+        hasher.add(sym->is_initialized ? 1 : 0);
+        hasher.add(sym->value.kind);
+        switch (sym->value.kind) {
+            case ConstantValue::Int: hasher.add(static_cast<uint64_t>(sym->value.integer)); break;
+            case ConstantValue::Float: {
+                uint64_t bits;
+                std::memcpy(&bits, &sym->value.real, sizeof(bits));
+                hasher.add(bits);
+                break;
+            }
+            case ConstantValue::Bool: hasher.add(sym->value.boolean ? 1 : 0); break;
+            case ConstantValue::None: break;
+        }
+        return hasher.h | 1;
+    }
+    
+    static bool dependencies_unchanged(const CachedFunction& cached, const GlobalTable& globals) {
+        for (const auto& dep : cached.dependencies) {
+            if (signature_hash(globals.find(dep.name)) != dep.signature) return false;
         }
         return true;
     }
+    
+public:
+    explicit IncrementalAnalyzer(const DiagnosticOptions& options = {})
+        : options(collecting(options)), global(this->options), worker(this->options) {}
+    
+    // Returns every diagnostic for the current module, ordered by line.
+    // Every function body is hashed again, so nodes may have been edited
+    // in place anywhere since the last update.
+    std::vector<Diagnostic> update(const std::vector<std::shared_ptr<ASTNode>>& top_level) {
+        return run(top_level, true);
+    }
+    
+    // The same when, of the top-level functions passed before, only those
+    // in edited were changed in place. Bodies of the others are not hashed
+    // again; signatures, new or replaced nodes and global declarations
+    // always are. Replacing a node needs no entry in edited.
+    std::vector<Diagnostic> update(const std::vector<std::shared_ptr<ASTNode>>& top_level,
+                                   const std::vector<const ASTNode*>& edited) {
+        for (const ASTNode* node : edited) root_hashes.erase(node);
+        return run(top_level, false);
+    }
+    
+    // Functions whose bodies the last update() actually re-checked
+    size_t last_rechecked() const {
+        return rechecked;
+    }
+    
+private:
+    std::vector<Diagnostic> run(const std::vector<std::shared_ptr<ASTNode>>& top_level, bool rehash_all) {
+        ++generation;
+        SemanticAnalyzer::IndexedDiagnostics errors;
+        global.begin_unit();
+        std::vector<size_t> functions = SemanticAnalyzer::collect_globals(global, top_level, errors);
+        const GlobalTable globals = global.freeze_globals();
+        
+        worker.begin_unit();
+        worker.globals = &globals;
+        rechecked = 0;
+        try {
+            for (size_t index : functions) {
+                auto func = static_cast<const FunctionNode*>(top_level[index].get());
+                uint64_t key = function_key(top_level[index], rehash_all);
+                
+                // Entries already seen in this update were checked or
+                // confirmed against the same globals
+                auto hit = cache.find(key);
+                if (hit == cache.end() || (hit->second.seen != generation && !dependencies_unchanged(hit->second, globals))) {
+                    hit = cache.insert_or_assign(key, check(globals, func)).first;
+                }
+                hit->second.seen = generation;
+                
+                for (const auto& d : hit->second.diagnostics) {
+                    errors.emplace_back(index, Diagnostic{d.line + func->line, d.message, d.code, d.severity});
+                }
+            }
+        } catch (...) {
+            worker.globals = nullptr;
+            throw;
+        }
+        worker.globals = nullptr;
+        
+        // Entries not seen in this update belong to deleted or edited code
+        for (auto it = cache.begin(); it != cache.end();) {
+            it = it->second.seen == generation ? std::next(it) : cache.erase(it);
+        }
+        for (auto it = root_hashes.begin(); it != root_hashes.end();) {
+            it = it->second.seen == generation ? std::next(it) : root_hashes.erase(it);
+        }
+        return SemanticAnalyzer::merge_diagnostics(errors, options.error_limit);
+    }
+    
+    CachedFunction check(const GlobalTable& globals, const FunctionNode* func) {
+        ++rechecked;
+        lookups.clear();
+        worker.global_lookups = &lookups;
+        try {
+            worker.analyze_function_body(func);
+        } catch (...) {
+            worker.reset_function_state();
+            worker.global_lookups = nullptr;
+            throw;
+        }
+        worker.global_lookups = nullptr;
+        
+        CachedFunction result;
+        result.diagnostics = worker.take_diagnostics();
+        for (auto& d : result.diagnostics) d.line -= func->line;
+        
+        std::sort(lookups.begin(), lookups.end());
+        lookups.erase(std::unique(lookups.begin(), lookups.end()), lookups.end());
+        for (std::string_view name : lookups) {
+            result.dependencies.push_back(Dependency{std::string(name), signature_hash(globals.find(name))});
+        }
+        return result;
+    }
 };
@@ -0,0 +1,690 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Benchmark driver for SemanticAnalyzer over a fixed synthetic corpus.
+//
+//   bench [case|variant...] [--scale N] [--runs N]
+//         [--save FILE] [--baseline FILE] [--max-slowdown PCT]
+//         [--retries N] [--advisory-throughput] [--max-alloc-growth PCT]
+//
+// Cases: wide, deep, symbols, errors, prefixed. Each runs under every variant:
+//
+//   tree/cold       shared_ptr AST, a fresh analyzer per run
+//   tree/warm       shared_ptr AST, one analyzer reused through begin_unit()
+//   arena/cold      the same tree allocated from one Arena
+//   flat/cold       FlatAST, a fresh analyzer per run
+//   flat/warm       FlatAST, one analyzer reused through begin_unit()
+//   module/serial   root's children through analyze_module on one thread,
+//                   one analyzer and its workers reused for every run
+//   module/parallel the same on a pool of four threads
+//   edit/rehash     IncrementalAnalyzer::update() on root's children after
+//                   a one-statement edit to the function nearest the middle
+//   edit/hinted     the same, telling update() which function was edited
+//
+// Module rows return rendered diagnostics, one message string each, while
+// the other rows stop at the records, so in cases with many diagnostics
+// their allocs/node are mostly messages. Edit rows count the whole module
+// as nodes, so their nodes/s says how update() scales with module size.
+//
+// With the prefixed case, a second table times NameKernel's hash and
+// equality on its names against std::hash and string_view ==. Which
+// kernel path runs depends on the build: its 32-byte AVX2 stripes need
+// -mavx2 (or -march=native); otherwise SSE2, NEON or scalar code runs.
+//
+// Everything is run by default. Tree construction and conversion are not
+// timed; each row reports the best of --runs samples, a sample repeating
+// the analysis until it takes about 20 ms, and samples of different rows
+// taking turns. Besides nodes/s each row shows its speed relative to
+// tree/cold of the same case in the same run, which stays put when only
+// the machine got slower. peak_kb is the high-water mark of the bytes the
+// analyzer (and, for module rows, its workers) held during the last run;
+// lookups/s counts find_symbol() calls and needs SEMANTIC_INSTRUMENT.
+//
+// --save writes nodes/s, allocs/node and relative speed per row to FILE.
+// --baseline compares against such a file and exits with 1 if any row is
+// slower than its baseline nodes/s by more than --max-slowdown percent
+// (default 10) or allocates more per node than --max-alloc-growth percent
+// (default 2) above it. Rows that look slow are re-sampled up to
+// --retries times (default 3) before they count. --advisory-throughput
+// only reports slowdowns, for machines other than the one the baseline
+// was recorded on; allocation counts carry over anywhere.
+
+// Counts every global allocation so that allocations per node can be
+// measured around analysis alone. Instrumented builds time themselves
+// too, so compare numbers only between builds with the same flags.
+static std::atomic<size_t> g_allocations{0};
+
+// The allocating overloads and the plain delete stay out of line: inlined,
+// GCC pairs the malloc with the free and warns (-Wmismatched-new-delete)
+__attribute__((noinline)) void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+// std::pmr::new_delete_resource allocates through these, so without them
+// nothing the analyzer allocates would be counted
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t align) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+    size_t rounded = (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    if (void* p = std::aligned_alloc(alignment, rounded)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    ::operator delete(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t align) noexcept {
+    ::operator delete(p, align);
+}
+
+struct GeneratedTree {
+    std::unique_ptr<Arena> arena; // First, so that it outlives the nodes in it
+    std::shared_ptr<ASTNode> root;
+    size_t nodes = 0;
+};
+
+class TreeBuilder {
+    GeneratedTree tree;
+    int line = 1;
+
+    // Nodes come from the arena when there is one
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&... args) {
+        if (tree.arena) return std::allocate_shared<T>(ArenaAllocator<T>(*tree.arena), std::forward<Args>(args)...);
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+public:
+    explicit TreeBuilder(bool use_arena) {
+        if (use_arena) tree.arena = std::make_unique<Arena>();
+    }
+
+    std::shared_ptr<FunctionNode> function(const std::string& name, int params) {
+        auto func = make<FunctionNode>();
+        func->name = name;
+        func->return_type = "i32";
+        func->line = line++;
+        for (int p = 0; p < params; ++p) {
+            auto param = make<ParameterNode>();
+            param->name = "p" + std::to_string(p);
+            param->type = p % 2 ? "i64" : "u8";
+            param->line = func->line;
+            func->parameters.push_back(param);
+            ++tree.nodes;
+        }
+        ++tree.nodes;
+        return func;
+    }
+
+    // kind cycles through let, var and const
+    std::shared_ptr<ASTNode> declaration(const std::string& name, int kind, bool with_initializer = true) {
+        std::shared_ptr<ASTNode> node;
+        std::shared_ptr<ExpressionNode> init;
+        if (with_initializer) {
+            init = make<IntegerLiteralNode>(line);
+            init->line = line;
+            ++tree.nodes;
+        }
+        switch (kind % 3) {
+            case 0: {
+                auto decl = make<LetDeclarationNode>();
+                decl->name = name;
+                decl->initializer = init;
+                node = decl;
+                break;
+            }
+            case 1: {
+                auto decl = make<VarDeclarationNode>();
+                decl->name = name;
+                decl->initializer = init;
+                node = decl;
+                break;
+            }
+            default: {
+                auto decl = make<ConstDeclarationNode>();
+                decl->name = name;
+                decl->initializer = init;
+                node = decl;
+                break;
+            }
+        }
+        node->line = line++;
+        ++tree.nodes;
+        return node;
+    }
+
+    // let name = source;
+    std::shared_ptr<ASTNode> copy(const std::string& name, const std::string& source) {
+        auto init = make<IdentifierNode>(source);
+        init->line = line;
+        auto decl = make<LetDeclarationNode>();
+        decl->name = name;
+        decl->initializer = init;
+        decl->line = line++;
+        tree.nodes += 2;
+        return decl;
+    }
+
+    GeneratedTree finish(std::shared_ptr<ASTNode> root) {
+        tree.root = std::move(root);
+        return std::move(tree);
+    }
+};
+
+// Many sibling functions under one root, a handful of locals each
+GeneratedTree make_wide(int scale, bool use_arena) {
+    TreeBuilder b(use_arena);
+    auto root = b.function("module", 0);
+    for (int f = 0; f < 2000 * scale; ++f) {
+        auto func = b.function("f" + std::to_string(f), 3);
+        for (int s = 0; s < 8; ++s) {
+            func->body.push_back(b.declaration("v" + std::to_string(s), s));
+        }
+        root->body.push_back(func);
+    }
+    return b.finish(root);
+}
+
+// Functions nested inside each other, one scope per level
+GeneratedTree make_deep(int scale, bool use_arena) {
+    TreeBuilder b(use_arena);
+    auto root = b.function("level0", 1);
+    auto current = root;
+    for (int depth = 1; depth < 500 * scale; ++depth) {
+        current->body.push_back(b.declaration("x", depth));
+        current->body.push_back(b.declaration("d" + std::to_string(depth), depth + 1));
+        auto next = b.function("level" + std::to_string(depth), 1);
+        current->body.push_back(next);
+        current = next;
+    }
+    return b.finish(root);
+}
+
+// Thousands of locals per scope, redeclared in nested scopes so that most
+// names are shadowed several times over
+GeneratedTree make_symbol_heavy(int scale, bool use_arena) {
+    TreeBuilder b(use_arena);
+    auto root = b.function("outer", 4);
+    auto current = root;
+    for (int level = 0; level < 8; ++level) {
+        for (int i = 0; i < 2000 * scale; ++i) {
+            current->body.push_back(b.declaration("sym" + std::to_string(i), i));
+        }
+        auto next = b.function("inner" + std::to_string(level), 4);
+        current->body.push_back(next);
+        current = next;
+    }
+    return b.finish(root);
+}
+
+// Duplicate names and missing initializers on most statements
+GeneratedTree make_error_heavy(int scale, bool use_arena) {
+    TreeBuilder b(use_arena);
+    auto root = b.function("module", 0);
+    for (int f = 0; f < 500 * scale; ++f) {
+        auto func = b.function("dup" + std::to_string(f % 50), 2);
+        for (int s = 0; s < 12; ++s) {
+            func->body.push_back(b.declaration("e" + std::to_string(s % 4), s, s % 3 == 0));
+        }
+        root->body.push_back(func);
+    }
+    return b.finish(root);
+}
+
+// 48 characters, the first 40 shared: long enough for NameKernel's
+// 32-byte stripes, with every difference in the last block
+std::string prefixed_name(int i) {
+    char name[64];
+    std::snprintf(name, sizeof name, "module_internal_generated_counter_value_%08d", i);
+    return name;
+}
+
+// Long names that differ only in their last digits, each read by the next
+// declaration, so that hashing and comparing names dominates
+GeneratedTree make_prefixed(int scale, bool use_arena) {
+    TreeBuilder b(use_arena);
+    auto root = b.function("module", 0);
+    for (int f = 0; f < 4; ++f) {
+        auto func = b.function("module_internal_function_" + std::to_string(f), 1);
+        std::string previous = "p0";
+        for (int i = 0; i < 2000 * scale; ++i) {
+            std::string name = prefixed_name(i);
+            func->body.push_back(b.copy(name, previous));
+            previous = name;
+        }
+        root->body.push_back(func);
+    }
+    return b.finish(root);
+}
+
+struct BenchCase {
+    const char* name;
+    GeneratedTree (*make)(int scale, bool use_arena);
+};
+
+const BenchCase kCases[] = {
+    {"wide", make_wide},
+    {"deep", make_deep},
+    {"symbols", make_symbol_heavy},
+    {"errors", make_error_heavy},
+    {"prefixed", make_prefixed},
+};
+
+enum class Layout { Tree, Arena, Flat, Module, Edit };
+
+struct Variant {
+    const char* name;
+    Layout layout;
+    bool warm;           // One analyzer for every run, reset with begin_unit()
+    unsigned threads;    // Module layout only. Fixed, since workers' allocations count too
+    bool hinted = false; // Edit layout only: update() is told which function changed
+};
+
+const Variant kVariants[] = {
+    {"tree/cold", Layout::Tree, false, 1},
+    {"tree/warm", Layout::Tree, true, 1},
+    {"arena/cold", Layout::Arena, false, 1},
+    {"flat/cold", Layout::Flat, false, 1},
+    {"flat/warm", Layout::Flat, true, 1},
+    {"module/serial", Layout::Module, true, 1},
+    {"module/parallel", Layout::Module, true, 4},
+    {"edit/rehash", Layout::Edit, true, 1},
+    {"edit/hinted", Layout::Edit, true, 1, true},
+};
+
+struct Result {
+    std::string key; // case and variant, e.g. "wide tree/cold"
+    double nodes_per_second = 0;
+    double allocations_per_node = 0;
+    double relative_speed = 0; // nodes/s over the case's tree/cold row in the same run, 0 without one
+};
+
+// One case under one variant, with everything it needs built up front so
+// that samples of all rows can be interleaved: a slow stretch on a shared
+// machine then costs every row one sample instead of one row all of them
+class Row {
+    const BenchCase& bench_case;
+    const Variant& variant;
+    const GeneratedTree& tree;
+    DiagnosticOptions options;
+    FlatAST flat;
+    std::vector<std::shared_ptr<ASTNode>> top_level;
+    std::unique_ptr<ThreadPool> pool;
+    // Module rows only: workers count their bytes in trackers of their
+    // own, so the module's peak is taken one level up, over everything
+    // the analyzer and its workers allocate. Any category will do.
+    MemoryTracker module_memory;
+    std::unique_ptr<SemanticAnalyzer> warm;
+    // Edit rows: a private copy of one top-level function, in top_level,
+    // and the statement toggled in and out of its body
+    std::unique_ptr<IncrementalAnalyzer> incremental;
+    std::shared_ptr<FunctionNode> edited;
+    std::shared_ptr<ASTNode> edit;
+    size_t reps = 1;
+    double best = 1e100;
+    size_t allocations = 0;
+    size_t diagnostics = 0;
+    size_t peak_bytes = 0; // Of the last run
+    uint64_t lookups = 0;  // find_symbol() calls in the last run, instrumented builds only
+    std::string report;
+
+    size_t analyze_once() {
+        if (variant.layout == Layout::Edit) {
+            if (!edited->body.empty() && edited->body.back() == edit) {
+                edited->body.pop_back();
+            } else {
+                edited->body.push_back(edit);
+            }
+            if (variant.hinted) return incremental->update(top_level, {edited.get()}).size();
+            return incremental->update(top_level).size();
+        }
+        if (variant.layout == Layout::Module) {
+            module_memory.reset_peak();
+            size_t count = warm->analyze_module(top_level, *pool).size();
+            peak_bytes = module_memory.peak_bytes();
+            return count;
+        }
+        if (warm) {
+            warm->begin_unit();
+            warm->reset_peak_memory();
+            SEMANTIC_STAT(uint64_t calls = warm->instrumentation().find_symbol_calls;)
+            if (variant.layout == Layout::Flat) warm->analyze(flat); else warm->analyze(tree.root.get());
+            peak_bytes = warm->memory().peak_bytes();
+            SEMANTIC_STAT(lookups = warm->instrumentation().find_symbol_calls - calls;)
+            SEMANTIC_STAT(report = warm->instrumentation_json();)
+            return warm->diagnostic_records().size();
+        }
+        SemanticAnalyzer analyzer(options);
+        if (variant.layout == Layout::Flat) analyzer.analyze(flat); else analyzer.analyze(tree.root.get());
+        peak_bytes = analyzer.memory().peak_bytes();
+        SEMANTIC_STAT(lookups = analyzer.instrumentation().find_symbol_calls;)
+        SEMANTIC_STAT(report = analyzer.instrumentation_json();)
+        return analyzer.diagnostic_records().size();
+    }
+
+public:
+    Row(const BenchCase& c, const Variant& v, const GeneratedTree& tree) : bench_case(c), variant(v), tree(tree) {
+        // Collect mode so that the error-heavy case runs to completion
+        options.throw_on_error = false;
+
+        if (v.layout == Layout::Flat) flat = FlatAST::from_tree(tree.root);
+        if (v.layout == Layout::Module || v.layout == Layout::Edit) {
+            top_level = static_cast<const FunctionNode*>(tree.root.get())->body;
+        }
+        if (v.layout == Layout::Module) pool = std::make_unique<ThreadPool>(v.threads);
+        if (v.layout == Layout::Edit) {
+            // The function nearest the middle, copied so that other rows
+            // keep seeing the tree unedited
+            size_t middle = top_level.size() / 2, k = SIZE_MAX;
+            auto distance = [&](size_t i) { return i > middle ? i - middle : middle - i; };
+            for (size_t i = 0; i < top_level.size(); ++i) {
+                if (top_level[i]->kind == NodeKind::Function && (k == SIZE_MAX || distance(i) < distance(k))) k = i;
+            }
+            edited = std::make_shared<FunctionNode>(*static_cast<const FunctionNode*>(top_level[k].get()));
+            top_level[k] = edited;
+            auto decl = std::make_shared<LetDeclarationNode>();
+            decl->name = "bench_edit";
+            decl->initializer = std::make_shared<IntegerLiteralNode>(1);
+            decl->line = decl->initializer->line = edited->line;
+            edit = decl;
+            incremental = std::make_unique<IncrementalAnalyzer>(options);
+        }
+        if (v.layout == Layout::Module) {
+            warm = std::make_unique<SemanticAnalyzer>(options, module_memory.resource(MemoryCategory::Symbols));
+        } else if (v.warm) {
+            warm = std::make_unique<SemanticAnalyzer>(options);
+        }
+
+        // An untimed first run grows the warm analyzer's tables and sizes
+        // the samples: small cases repeat until one takes about 20 ms
+        auto start = std::chrono::steady_clock::now();
+        diagnostics = analyze_once();
+        double once = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        reps = std::min<size_t>(1000, std::max<size_t>(1, static_cast<size_t>(0.02 / std::max(once, 1e-6))));
+    }
+
+    void sample() {
+        size_t before = g_allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < reps; ++k) diagnostics = analyze_once();
+        auto end = std::chrono::steady_clock::now();
+        allocations = g_allocations.load(std::memory_order_relaxed) - before;
+
+        best = std::min(best, std::chrono::duration<double>(end - start).count() / reps);
+    }
+
+    Result result() const {
+        return Result{std::string(bench_case.name) + " " + variant.name, tree.nodes / best,
+                      double(allocations) / reps / tree.nodes};
+    }
+
+    void print(const Result& result) const {
+        // Not counted without SEMANTIC_INSTRUMENT, nor for module rows,
+        // whose workers keep counters of their own
+        char lookup_rate[32] = "-";
+        if (lookups) std::snprintf(lookup_rate, sizeof lookup_rate, "%.0f", lookups / best);
+        // Nor is memory for edit rows, as IncrementalAnalyzer has no tracker
+        char peak_kb[32] = "-";
+        if (peak_bytes) std::snprintf(peak_kb, sizeof peak_kb, "%zu", peak_bytes / 1024);
+        std::printf("%-8s %-15s %9zu %14.0f %14s %12s %12.3f %10.3f %8.3f %8zu\n",
+                    bench_case.name, variant.name, tree.nodes, result.nodes_per_second, lookup_rate,
+                    peak_kb, result.allocations_per_node, best * 1e3, result.relative_speed, diagnostics);
+
+        // Built with SEMANTIC_INSTRUMENT: the last run's counters, on stderr
+        // so that the table stays parseable
+        if (!report.empty()) std::fprintf(stderr, "%s %s %s\n", bench_case.name, variant.name, report.c_str());
+    }
+};
+
+// Fills in relative_speed for every row whose case has a tree/cold row
+void set_relative_speeds(std::vector<Result>& results) {
+    for (auto& r : results) {
+        std::string reference = r.key.substr(0, r.key.find(' ')) + " tree/cold";
+        auto base = std::find_if(results.begin(), results.end(), [&](const Result& b) { return b.key == reference; });
+        if (base != results.end()) r.relative_speed = r.nodes_per_second / base->nodes_per_second;
+    }
+}
+
+#ifdef SEMANTIC_INSTRUMENT
+constexpr const char* kBuildFlavor = "instrumented";
+#else
+constexpr const char* kBuildFlavor = "uninstrumented";
+#endif
+
+// One "case variant nodes_per_second allocations_per_node relative_speed"
+// line per row, after a header saying how and where it was recorded;
+// lines starting with # are comments
+bool save_baseline(const char* path, const std::vector<Result>& results, int runs, int scale) {
+    FILE* f = std::fopen(path, "w");
+    if (!f) return false;
+    std::fprintf(f, "# bench baseline: case variant nodes_per_second allocations_per_node relative_speed\n");
+    std::fprintf(f, "# --runs %d --scale %d, %u hardware threads, %s build, compiler %s\n", runs, scale,
+                 std::thread::hardware_concurrency(), kBuildFlavor, __VERSION__);
+    for (const auto& r : results) {
+        std::fprintf(f, "%s %.0f %.4f %.3f\n", r.key.c_str(), r.nodes_per_second, r.allocations_per_node,
+                     r.relative_speed);
+    }
+    return std::fclose(f) == 0;
+}
+
+bool load_baseline(const char* path, std::vector<Result>& baseline) {
+    FILE* f = std::fopen(path, "r");
+    if (!f) return false;
+    char line[256];
+    while (std::fgets(line, sizeof line, f)) {
+        char name[64], variant[64];
+        Result r;
+        if (line[0] == '#' || std::sscanf(line, "%63s %63s %lf %lf %lf", name, variant, &r.nodes_per_second,
+                                          &r.allocations_per_node, &r.relative_speed) != 5) {
+            continue;
+        }
+        r.key = std::string(name) + " " + variant;
+        baseline.push_back(r);
+    }
+    std::fclose(f);
+    return true;
+}
+
+const Result* find_result(const std::vector<Result>& results, const std::string& key) {
+    auto it = std::find_if(results.begin(), results.end(), [&](const Result& r) { return r.key == key; });
+    return it == results.end() ? nullptr : &*it;
+}
+
+bool slower(const Result& r, const Result& base, double max_slowdown) {
+    return r.nodes_per_second < base.nodes_per_second * (1 - max_slowdown / 100);
+}
+
+// Returns the number of rows that regressed against baseline. Slowdowns
+// count unless advisory; relative speeds are shown alongside, since a
+// ratio that held steady points at the machine rather than the code.
+int compare(const std::vector<Result>& results, const std::vector<Result>& baseline,
+            double max_alloc_growth, double max_slowdown, bool advisory) {
+    int regressions = 0;
+    for (const auto& r : results) {
+        const Result* base = find_result(baseline, r.key);
+        if (!base) {
+            std::fprintf(stderr, "%s: no baseline\n", r.key.c_str());
+            continue;
+        }
+        if (slower(r, *base, max_slowdown)) {
+            std::fprintf(stderr, "%s %s: %.0f nodes/s, %.1f%% below baseline %.0f (%.3fx tree/cold, baseline %.3fx)\n",
+                         advisory ? "slower" : "REGRESSION", r.key.c_str(), r.nodes_per_second,
+                         (1 - r.nodes_per_second / base->nodes_per_second) * 100, base->nodes_per_second,
+                         r.relative_speed, base->relative_speed);
+            if (!advisory) ++regressions;
+        }
+        // The small absolute slack keeps near-zero baselines from failing on rounding
+        if (r.allocations_per_node > base->allocations_per_node * (1 + max_alloc_growth / 100) + 0.001) {
+            std::fprintf(stderr, "REGRESSION %s: %.4f allocs/node, baseline %.4f\n",
+                         r.key.c_str(), r.allocations_per_node, base->allocations_per_node);
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+// NameKernel against the standard library on the prefixed case's names:
+// the hash and the equality test the symbol tables run per probe. Equal
+// names are compared in separate buffers, as a lookup would; unequal
+// ones are neighbours, differing in the last digit.
+void bench_name_kernel(int scale, int runs) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 8000 * scale; ++i) names.push_back(prefixed_name(i));
+    const std::vector<std::string> copies = names;
+    const size_t n = names.size();
+    const int reps = 50;
+
+    std::printf("\n%-8s %-15s %9s %14s %10s\n", "names", "variant", "names", "names/s", "ns/name");
+    uint64_t sink = 0;
+    auto time = [&](const char* variant, auto&& pass) {
+        double best = 1e100;
+        for (int r = 0; r < runs; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            for (int k = 0; k < reps; ++k) sink += pass();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps);
+        }
+        std::printf("%-8s %-15s %9zu %14.0f %10.2f\n", "names", variant, n, n / best, best * 1e9 / n);
+    };
+    time("kernel/hash", [&] {
+        uint64_t h = 0;
+        for (const auto& name : names) h += NameKernel::hash(name);
+        return h;
+    });
+    time("std/hash", [&] {
+        uint64_t h = 0;
+        for (const auto& name : names) h += std::hash<std::string_view>()(name);
+        return h;
+    });
+    time("kernel/equal", [&] {
+        uint64_t same = 0;
+        for (size_t i = 0; i < n; ++i) {
+            same += NameKernel::equal(names[i], copies[i]) + NameKernel::equal(names[i], copies[i ^ 1]);
+        }
+        return same;
+    });
+    time("std/equal", [&] {
+        uint64_t same = 0;
+        for (size_t i = 0; i < n; ++i) {
+            same += (std::string_view(names[i]) == copies[i]) + (std::string_view(names[i]) == copies[i ^ 1]);
+        }
+        return same;
+    });
+    // Keeps the passes from being optimized away
+    if (sink == 42) std::printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int scale = 1;
+    int runs = 5;
+    const char* save_path = nullptr;
+    const char* baseline_path = nullptr;
+    double max_alloc_growth = 2;
+    double max_slowdown = 10;
+    int retries = 3;
+    bool advisory = false;
+    std::vector<const char*> selected;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--scale") && i + 1 < argc) {
+            scale = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--save") && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--max-alloc-growth") && i + 1 < argc) {
+            max_alloc_growth = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--max-slowdown") && i + 1 < argc) {
+            max_slowdown = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--retries") && i + 1 < argc) {
+            retries = std::max(0, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--advisory-throughput")) {
+            advisory = true;
+        } else {
+            selected.push_back(argv[i]);
+        }
+    }
+
+    // A selection can name cases, variants or both; an empty side means all
+    auto wanted = [&](const char* name, bool is_case) {
+        bool any = false;
+        for (const char* s : selected) {
+            bool s_is_case = std::any_of(std::begin(kCases), std::end(kCases),
+                                         [&](const BenchCase& c) { return !std::strcmp(c.name, s); });
+            if (s_is_case != is_case) continue;
+            any = true;
+            if (!std::strcmp(name, s)) return true;
+        }
+        return !any;
+    };
+
+    std::vector<Result> baseline;
+    if (baseline_path && !load_baseline(baseline_path, baseline)) {
+        std::fprintf(stderr, "cannot read baseline %s\n", baseline_path);
+        return 2;
+    }
+
+    std::deque<GeneratedTree> trees; // Rows point into these
+    std::vector<std::unique_ptr<Row>> rows;
+    for (const auto& c : kCases) {
+        if (!wanted(c.name, true)) continue;
+        const GeneratedTree& heap_tree = trees.emplace_back(c.make(scale, false));
+        const GeneratedTree& arena_tree = trees.emplace_back(c.make(scale, true));
+        for (const auto& v : kVariants) {
+            if (!wanted(v.name, false)) continue;
+            rows.push_back(std::make_unique<Row>(c, v, v.layout == Layout::Arena ? arena_tree : heap_tree));
+        }
+    }
+    std::vector<Result> results(rows.size());
+    auto measure = [&](const std::vector<size_t>& which) {
+        for (int r = 0; r < runs; ++r) {
+            for (size_t i : which) rows[i]->sample();
+        }
+        for (size_t i = 0; i < rows.size(); ++i) results[i] = rows[i]->result();
+        set_relative_speeds(results);
+    };
+    std::vector<size_t> all(rows.size());
+    for (size_t i = 0; i < all.size(); ++i) all[i] = i;
+    measure(all);
+
+    // A row can look slow because the machine was busy while it ran. It
+    // gets another --runs samples, up to --retries times; samples only
+    // ever improve the best, so a real slowdown still shows.
+    for (int attempt = 0; baseline_path && attempt < retries; ++attempt) {
+        std::vector<size_t> slow;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result* base = find_result(baseline, results[i].key);
+            if (base && slower(results[i], *base, max_slowdown)) slow.push_back(i);
+        }
+        if (slow.empty()) break;
+        measure(slow);
+    }
+
+    std::printf("%-8s %-15s %9s %14s %14s %12s %12s %10s %8s %8s\n", "case", "variant", "nodes", "nodes/s",
+                "lookups/s", "peak_kb", "allocs/node", "best_ms", "relative", "diags");
+    for (size_t i = 0; i < rows.size(); ++i) rows[i]->print(results[i]);
+    if (wanted("prefixed", true)) bench_name_kernel(scale, runs);
+
+    if (save_path && !save_baseline(save_path, results, runs, scale)) {
+        std::fprintf(stderr, "cannot write baseline %s\n", save_path);
+        return 2;
+    }
+    if (baseline_path && compare(results, baseline, max_alloc_growth, max_slowdown, advisory) > 0) return 1;
+    return 0;
+}
@@ -1,22 +1,30 @@
 int main() {
  
-    auto func = std::make_shared<FunctionNode>();
+    // Node storage comes from one arena, declared first so that it outlives
+    // every node. The nodes are still shared_ptrs: each is destroyed when
+    // its last reference goes, freeing its strings and child vectors on
+    // the heap, while the arena hands back the node memory itself in one
+    // go when it is destroyed.
+    Arena ast_arena;
+    ArenaAllocator<ASTNode> alloc(ast_arena);
+    
+    auto func = std::allocate_shared<FunctionNode>(alloc);
     func->name = "main";
     func->return_type = "void";
     func->line = 1;
     
 
-    auto let_a = std::make_shared<LetDeclarationNode>();
+    auto let_a = std::allocate_shared<LetDeclarationNode>(alloc);
     let_a->name = "a";
     let_a->type_annotation = "i32";
-    let_a->initializer = std::make_shared<IntegerLiteralNode>(42);
+    let_a->initializer = std::allocate_shared<IntegerLiteralNode>(alloc, 42);
     let_a->line = 2;
     func->body.push_back(let_a);
     
 
     SemanticAnalyzer analyzer;
     try {
-        analyzer.analyze(func);
+        analyzer.analyze(func.get());
         std::cout << "Semantic analysis passed successfully!" << std::endl;
     } catch (const SemanticError& e) {
         std::cerr << "Semantic error at line " << e.line << ": " << e.what() << std::endl;
@@ -0,0 +1,1138 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Regression checks for SemanticAnalyzer, built like bench.cpp: compiled
+// after the AST header and SemanticAnalyzer.cpp, then run from the build.
+//
+//   tests [name...]
+//
+// Runs every test by default, or only those named. Each failed check is
+// printed with its line; the exit code is 1 if any check failed.
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            std::printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++g_failures;                                                      \
+        }                                                                      \
+    } while (0)
+
+using Module = std::vector<std::shared_ptr<ASTNode>>;
+
+static std::shared_ptr<FunctionNode> function(const std::string& name, const std::string& return_type, int line) {
+    auto func = std::make_shared<FunctionNode>();
+    func->name = name;
+    func->return_type = return_type;
+    func->line = line;
+    return func;
+}
+
+static void parameter(FunctionNode& func, const std::string& name, const std::string& type) {
+    auto param = std::make_shared<ParameterNode>();
+    param->name = name;
+    param->type = type;
+    param->line = func.line;
+    func.parameters.push_back(param);
+}
+
+template <typename T>
+static std::shared_ptr<T> declaration(const std::string& name, const char* type,
+                                      std::shared_ptr<ExpressionNode> init, int line) {
+    auto decl = std::make_shared<T>();
+    decl->name = name;
+    if (type) decl->type_annotation = type;
+    decl->initializer = std::move(init);
+    decl->line = line;
+    return decl;
+}
+
+static std::shared_ptr<ExpressionNode> integer(long long value, int line) {
+    auto node = std::make_shared<IntegerLiteralNode>(value);
+    node->line = line;
+    return node;
+}
+
+static std::shared_ptr<ExpressionNode> identifier(const std::string& name, int line) {
+    auto node = std::make_shared<IdentifierNode>(name);
+    node->line = line;
+    return node;
+}
+
+static std::shared_ptr<ExpressionNode> binary(const std::string& op, std::shared_ptr<ExpressionNode> left,
+                                              std::shared_ptr<ExpressionNode> right, int line) {
+    auto node = std::make_shared<BinaryExpressionNode>(op, std::move(left), std::move(right));
+    node->line = line;
+    return node;
+}
+
+static std::shared_ptr<ExpressionNode> call(const std::string& callee, Module::size_type args, int line) {
+    auto node = std::make_shared<CallExpressionNode>(callee);
+    for (Module::size_type i = 0; i < args; ++i) node->arguments.push_back(integer(1, line));
+    node->line = line;
+    return node;
+}
+
+// Diagnostics as "line severity code: message", in line order, for
+// comparing modes
+static std::vector<std::string> rendered(std::vector<Diagnostic> diagnostics) {
+    std::stable_sort(diagnostics.begin(), diagnostics.end(),
+                     [](const Diagnostic& a, const Diagnostic& b) { return a.line < b.line; });
+    std::vector<std::string> lines;
+    for (const auto& d : diagnostics) {
+        const char* severity = d.severity == Severity::Error ? "error" : d.severity == Severity::Warning ? "warning" : "note";
+        lines.push_back(std::to_string(d.line) + " " + severity + " " + std::to_string(static_cast<unsigned>(d.code)) +
+                        ": " + d.message);
+    }
+    return lines;
+}
+
+static std::string rendered(int line, DiagnosticCode code, const std::string& message) {
+    return rendered({Diagnostic{line, message, code, severity_of(code)}})[0];
+}
+
+static std::vector<std::string> serial(const Module& module, const DiagnosticOptions& options) {
+    SemanticAnalyzer analyzer(options);
+    analyzer.begin_unit();
+    analyzer.declare_ahead(module);
+    for (const auto& node : module) analyzer.feed(node);
+    return rendered(analyzer.end_unit());
+}
+
+static void dump(const char* mode, const std::vector<std::string>& lines) {
+    std::printf("  %s:\n", mode);
+    for (const auto& line : lines) std::printf("    %s\n", line.c_str());
+}
+
+// Serial, parallel, incremental and asynchronous analysis report the
+// same diagnostics
+static void expect_modes_agree(const Module& module, DiagnosticOptions options = {}) {
+    options.throw_on_error = false;
+    std::vector<std::string> expected = serial(module, options);
+    ThreadPool pool(2);
+    std::vector<std::string> parallel = rendered(SemanticAnalyzer::analyze_parallel(module, pool, options));
+    IncrementalAnalyzer incremental(options);
+    std::vector<std::string> first = rendered(incremental.update(module));
+    std::vector<std::string> second = rendered(incremental.update(module));
+    SemanticAnalyzer async_analyzer(options);
+    std::vector<std::string> async = rendered(async_analyzer.analyze_async(module, CancellationToken()).get().diagnostics);
+    CHECK(parallel == expected);
+    CHECK(first == expected);
+    CHECK(second == expected);
+    CHECK(incremental.last_rechecked() == 0);
+    CHECK(async == expected);
+    if (parallel != expected || first != expected || second != expected || async != expected) {
+        dump("serial", expected);
+        dump("parallel", parallel);
+        dump("incremental", first);
+        dump("async", async);
+    }
+}
+
+// Includes a call to a later function and a use of a later global, which
+// every mode resolves through the signature pre-pass
+static Module mixed_module() {
+    Module module;
+    module.push_back(declaration<ConstDeclarationNode>("LIMIT", "i32", integer(10, 1), 1));
+
+    auto add = function("add", "i32", 2);
+    parameter(*add, "a", "i32");
+    parameter(*add, "b", "i32");
+    add->body.push_back(declaration<LetDeclarationNode>("sum", "i32",
+                                                        binary("+", identifier("a", 3), identifier("b", 3), 3), 3));
+    add->body.push_back(declaration<LetDeclarationNode>("unused", nullptr, integer(1, 4), 4));
+    module.push_back(add);
+
+    auto broken = function("broken", "i32", 6);
+    broken->body.push_back(declaration<LetDeclarationNode>("flag", "bool", integer(1, 7), 7));
+    broken->body.push_back(declaration<VarDeclarationNode>("later", "i32", nullptr, 8));
+    broken->body.push_back(declaration<LetDeclarationNode>("r", nullptr, call("add", 1, 9), 9));
+    broken->body.push_back(declaration<LetDeclarationNode>("m", nullptr, identifier("missing", 10), 10));
+    broken->body.push_back(declaration<LetDeclarationNode>("r", nullptr, identifier("LIMIT", 11), 11));
+    broken->body.push_back(declaration<LetDeclarationNode>("ahead", "i32", call("later_fn", 2, 12), 12));
+    broken->body.push_back(declaration<LetDeclarationNode>("scale", "i32", identifier("SCALE", 13), 13));
+    module.push_back(broken);
+
+    auto later_fn = function("later_fn", "bool", 15);
+    parameter(*later_fn, "x", "i32");
+    module.push_back(later_fn);
+    module.push_back(declaration<ConstDeclarationNode>("SCALE", "i32", integer(3, 17), 17));
+    return module;
+}
+
+static void test_modes_agree() {
+    Module module = mixed_module();
+    expect_modes_agree(module);
+
+    DiagnosticOptions limited;
+    limited.error_limit = 2;
+    expect_modes_agree(module, limited);
+
+    // Severity and code survive into the public diagnostics
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    std::vector<std::string> lines = serial(module, options);
+    CHECK(std::count(lines.begin(), lines.end(), rendered(4, DiagnosticCode::UnusedVariable, "Unused variable 'unused'")) == 1);
+    CHECK(std::count(lines.begin(), lines.end(), rendered(9, DiagnosticCode::ArgumentCount,
+                                                          "Function 'add' expects 2 arguments, got 1")) == 1);
+
+    // The later function is found, so its signature is checked
+    CHECK(std::count(lines.begin(), lines.end(), rendered(12, DiagnosticCode::ArgumentCount,
+                                                          "Function 'later_fn' expects 1 arguments, got 2")) == 1);
+    CHECK(std::count_if(lines.begin(), lines.end(), [](const std::string& line) {
+              return line.find("Undefined") != std::string::npos && line.find("missing") == std::string::npos;
+          }) == 0);
+
+    // A thrown error keeps its code too
+    SemanticAnalyzer throwing;
+    std::vector<Diagnostic> batch = throwing.analyze_batch({module[2]})[0];
+    CHECK(!batch.empty() && batch.back().code == DiagnosticCode::LetTypeMismatch &&
+          batch.back().severity == Severity::Error);
+}
+
+// A module analyzer reuses its workers from call to call, and in
+// throwing mode raises the error a serial run would hit first
+static void test_module_analysis() {
+    Module module = mixed_module();
+    auto late = function("late_error", "i32", 19);
+    late->body.push_back(declaration<LetDeclarationNode>("wrong", "bool", integer(2, 20), 20));
+    module.push_back(late);
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    std::vector<std::string> expected = serial(module, options);
+    ThreadPool pool(2);
+    SemanticAnalyzer collecting(options);
+    CHECK(rendered(collecting.analyze_module(module, pool)) == expected);
+    CHECK(rendered(collecting.analyze_module(module, pool)) == expected);
+
+    int serial_line = 0, parallel_line = 0;
+    try {
+        SemanticAnalyzer analyzer;
+        analyzer.begin_unit();
+        analyzer.declare_ahead(module);
+        for (const auto& node : module) analyzer.feed(node);
+    } catch (const SemanticError& e) {
+        serial_line = e.line;
+    }
+    SemanticAnalyzer throwing;
+    for (int run = 0; run < 2; ++run) {
+        parallel_line = 0;
+        try {
+            throwing.analyze_module(module, pool);
+        } catch (const SemanticError& e) {
+            parallel_line = e.line;
+        }
+        CHECK(serial_line == 7 && parallel_line == serial_line);
+    }
+}
+
+// Signature errors are reported once, whichever mode checks the body
+static void test_unknown_types_reported_once() {
+    auto func = function("odd", "nosuch", 1);
+    parameter(*func, "p", "alsonosuch");
+    func->body.push_back(declaration<LetDeclarationNode>("q", nullptr, identifier("p", 2), 2));
+    Module module{func};
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    std::vector<std::string> lines = serial(module, options);
+    CHECK(std::count(lines.begin(), lines.end(), rendered(1, DiagnosticCode::UnknownType, "Unknown type: nosuch")) == 1);
+    CHECK(std::count(lines.begin(), lines.end(), rendered(1, DiagnosticCode::UnknownType, "Unknown type: alsonosuch")) == 1);
+    expect_modes_agree(module);
+
+    // An initializer isn't also a mismatch against a type that doesn't exist
+    auto decl = function("decl", "i32", 4);
+    decl->body.push_back(declaration<LetDeclarationNode>("x", "nosuch", integer(1, 5), 5));
+    decl->body.push_back(declaration<LetDeclarationNode>("y", "nosuch", identifier("x", 6), 6));
+    std::vector<std::string> decl_lines = serial({decl}, options);
+    CHECK(std::count(decl_lines.begin(), decl_lines.end(),
+                     rendered(5, DiagnosticCode::UnknownType, "Unknown type: nosuch")) == 1);
+    CHECK(std::count(decl_lines.begin(), decl_lines.end(),
+                     rendered(6, DiagnosticCode::UnknownType, "Unknown type: nosuch")) == 1);
+    CHECK(std::count_if(decl_lines.begin(), decl_lines.end(), [](const std::string& line) {
+              return line.find("Type mismatch") != std::string::npos;
+          }) == 0);
+    expect_modes_agree({decl});
+}
+
+// Warnings are recorded but don't count toward the error limit
+static void test_error_limit_counts_errors() {
+    auto quiet = function("quiet", "i32", 1);
+    quiet->body.push_back(declaration<LetDeclarationNode>("idle", nullptr, integer(1, 2), 2));
+    auto loud = function("loud", "i32", 4);
+    loud->body.push_back(declaration<VarDeclarationNode>("later", "i32", nullptr, 5));
+    loud->body.push_back(declaration<LetDeclarationNode>("m", nullptr, identifier("missing", 6), 6));
+    Module module{quiet, loud};
+
+    DiagnosticOptions options;
+    options.error_limit = 1;
+    SemanticAnalyzer analyzer(options);
+    analyzer.begin_unit();
+    bool thrown = false;
+    try {
+        for (const auto& node : module) analyzer.feed(node);
+    } catch (const SemanticError& e) {
+        thrown = true;
+        CHECK(e.code == DiagnosticCode::VarRequiresInitializer);
+        CHECK(e.line == 5);
+    }
+    CHECK(thrown);
+    CHECK(analyzer.diagnostics().size() == 1); // The unused 'idle'
+
+    // Collecting: the one error, plus the warnings before it
+    std::vector<std::string> expected{
+        rendered(2, DiagnosticCode::UnusedVariable, "Unused variable 'idle'"),
+        rendered(5, DiagnosticCode::VarRequiresInitializer, "var declaration requires initializer"),
+    };
+    options.throw_on_error = false;
+    CHECK(serial(module, options) == expected);
+    expect_modes_agree(module, options);
+}
+
+// A subtree shared between scopes is checked against each scope
+static void test_shared_subtree_scopes() {
+    auto shared = binary("+", identifier("x", 3), integer(1, 3), 3);
+    auto wide = function("wide", "i32", 1);
+    wide->body.push_back(declaration<LetDeclarationNode>("x", "i32", integer(1, 2), 2));
+    wide->body.push_back(declaration<LetDeclarationNode>("a", "i32", shared, 3));
+    auto flag = function("flag", "i32", 5);
+    auto truth = std::make_shared<BoolLiteralNode>(true);
+    truth->line = 6;
+    flag->body.push_back(declaration<LetDeclarationNode>("x", "bool", truth, 6));
+    flag->body.push_back(declaration<LetDeclarationNode>("b", "i32", shared, 7));
+    Module module{wide, flag};
+
+    // Both errors are about the shared node, so both are on its line
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    std::vector<std::string> lines = serial(module, options);
+    CHECK(std::count(lines.begin(), lines.end(), rendered(6, DiagnosticCode::UnusedVariable, "Unused variable 'x'")) == 0);
+    CHECK(std::count(lines.begin(), lines.end(),
+                     rendered(3, DiagnosticCode::InvalidBinaryOperands, "Invalid operand types for '+'")) == 1);
+    expect_modes_agree(module, options);
+
+    // Across analyze() calls on one analyzer too
+    SemanticAnalyzer analyzer(options);
+    analyzer.analyze(wide);
+    CHECK(analyzer.expression_type(shared.get())->kind() == TypeKind::Int);
+    analyzer.analyze(flag);
+    CHECK(rendered(analyzer.diagnostics()) == lines);
+}
+
+// Each fed node starts with an empty type cache, however large it grew
+static void test_expression_types_reset() {
+    SemanticAnalyzer analyzer;
+    analyzer.begin_unit();
+    auto big = function("big", "i32", 1);
+    std::vector<std::shared_ptr<ExpressionNode>> inits;
+    for (int i = 0; i < 1000; ++i) {
+        inits.push_back(integer(i, 2 + i));
+        big->body.push_back(declaration<LetDeclarationNode>("v" + std::to_string(i), "i32", inits.back(), 2 + i));
+    }
+    analyzer.feed(big);
+    CHECK(analyzer.expression_type(inits[0].get()) && analyzer.expression_type(inits[999].get()));
+
+    auto small = function("small", "i32", 2000);
+    auto init = integer(7, 2001);
+    small->body.push_back(declaration<LetDeclarationNode>("w", "i64", init, 2001));
+    analyzer.feed(small);
+    CHECK(!analyzer.expression_type(inits[0].get()) && !analyzer.expression_type(inits[999].get()));
+    CHECK(analyzer.expression_type(init.get()) != nullptr);
+
+    analyzer.begin_unit();
+    CHECK(!analyzer.expression_type(init.get()));
+}
+
+// A unit that throws part way through leaves nothing behind for the next
+static void test_aborted_unit() {
+    auto outer = function("outer", "i32", 1);
+    outer->body.push_back(declaration<LetDeclarationNode>("kept", nullptr, integer(1, 2), 2));
+    auto inner = function("inner", "i32", 3);
+    inner->body.push_back(declaration<LetDeclarationNode>("local", nullptr, integer(1, 4), 4));
+    inner->body.push_back(declaration<LetDeclarationNode>("bad", "bool", integer(1, 5), 5));
+    outer->body.push_back(inner);
+
+    auto next = function("next", "i32", 10);
+    next->body.push_back(declaration<LetDeclarationNode>("fresh", nullptr, integer(1, 11), 11));
+
+    SemanticAnalyzer analyzer;
+    bool thrown = false;
+    try {
+        analyzer.analyze(outer);
+    } catch (const SemanticError&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    FlatAST flat = FlatAST::from_tree(outer);
+    thrown = false;
+    try {
+        analyzer.analyze(flat);
+    } catch (const SemanticError&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    analyzer.begin_unit();
+    analyzer.feed(next);
+    CHECK(rendered(analyzer.end_unit()) ==
+          std::vector<std::string>{rendered(11, DiagnosticCode::UnusedVariable, "Unused variable 'fresh'")});
+}
+
+// Running over the memory budget stops reference tracking for that unit
+// only
+static void test_memory_budget_per_unit() {
+    auto big = function("big", "i32", 1);
+    for (int i = 0; i < 3000; ++i) {
+        auto init = i ? identifier("v" + std::to_string(i - 1), 2 + i) : integer(1, 2);
+        big->body.push_back(declaration<LetDeclarationNode>("v" + std::to_string(i), "i32", init, 2 + i));
+    }
+    auto small = function("small", "i32", 1);
+    small->body.push_back(declaration<LetDeclarationNode>("a", nullptr, integer(1, 2), 2));
+    small->body.push_back(declaration<LetDeclarationNode>("b", nullptr, identifier("a", 3), 3));
+
+    // Between what the unit leaves live with and without references, so
+    // that dropping them is enough
+    size_t live[2];
+    for (int tracked = 0; tracked < 2; ++tracked) {
+        SemanticAnalyzer probe;
+        probe.track_references(tracked);
+        probe.begin_unit();
+        probe.feed(big);
+        live[tracked] = probe.memory().live_bytes();
+    }
+    CHECK(live[1] > live[0]);
+
+    SemanticAnalyzer analyzer;
+    analyzer.track_references(true);
+    analyzer.set_memory_budget((live[0] + live[1]) / 2);
+    analyzer.begin_unit();
+    analyzer.feed(big);
+    CHECK(analyzer.degraded_by_memory_budget());
+    CHECK(analyzer.references().size() == 0);
+
+    analyzer.set_memory_budget(0);
+    analyzer.begin_unit();
+    analyzer.feed(small);
+    CHECK(!analyzer.degraded_by_memory_budget());
+    CHECK(analyzer.references().size() == 1);
+}
+
+// Nesting far past what a recursive walk would survive on a default stack
+static void test_deep_input() {
+    const int depth = 200000;
+    std::shared_ptr<ExpressionNode> chain = integer(0, 2);
+    for (int i = 0; i < depth; ++i) chain = binary("+", chain, integer(i, 2), 2);
+
+    auto func = function("deep", "i32", 1);
+    func->body.push_back(declaration<LetDeclarationNode>("total", "i32", chain, 2));
+    Module module{func};
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    std::vector<std::string> expected = serial(module, options);
+    CHECK(expected.size() == 1); // The unused 'total'
+
+    FlatAST flat = FlatAST::from_tree(func);
+    SemanticAnalyzer analyzer(options);
+    analyzer.analyze(flat);
+    CHECK(rendered(analyzer.diagnostics()) == expected);
+
+    CHECK(rendered(SemanticAnalyzer::analyze_parallel(module, options)) == expected);
+
+    IncrementalAnalyzer incremental(options);
+    CHECK(rendered(incremental.update(module)) == expected);
+    CHECK(rendered(incremental.update(module)) == expected);
+    CHECK(incremental.last_rechecked() == 0);
+
+    // Unwinding a deep tree recursively would overflow too
+    while (auto next = std::dynamic_pointer_cast<BinaryExpressionNode>(chain)) {
+        chain = next->left;
+        next->left.reset();
+    }
+}
+
+// Edits re-check the edited function and whatever depends on its signature
+static void test_incremental_invalidation() {
+    auto callee = function("value", "i32", 1);
+    auto first = function("first", "i32", 3);
+    first->body.push_back(declaration<LetDeclarationNode>("v", "i32", call("value", 0, 4), 4));
+    auto second = function("second", "i32", 6);
+    second->body.push_back(declaration<LetDeclarationNode>("w", "i32", integer(2, 7), 7));
+    Module module{callee, first, second};
+
+    IncrementalAnalyzer incremental;
+    CHECK(rendered(incremental.update(module)).size() == 2);
+    CHECK(incremental.last_rechecked() == 3);
+
+    incremental.update(module);
+    CHECK(incremental.last_rechecked() == 0);
+
+    // Only 'first' calls 'value', so only the two of them are re-checked
+    callee->return_type = "bool";
+    std::vector<std::string> changed = rendered(incremental.update(module));
+    CHECK(incremental.last_rechecked() == 2);
+    CHECK(std::count(changed.begin(), changed.end(),
+                     rendered(4, DiagnosticCode::LetTypeMismatch, "Type mismatch in let declaration")) == 1);
+    expect_modes_agree(module);
+}
+
+// Bodies fold global constants, so a changed value re-checks its users
+static void test_incremental_constant_value() {
+    auto zero = declaration<ConstDeclarationNode>("DIVISOR", "i32", integer(0, 1), 1);
+    auto user = function("user", "i32", 3);
+    user->body.push_back(declaration<ConstDeclarationNode>("Q", "i32", binary("/", integer(10, 4), identifier("DIVISOR", 4), 4), 4));
+    Module module{zero, user};
+
+    const std::string division = rendered(4, DiagnosticCode::DivisionByZero, "Division by zero in constant expression");
+    IncrementalAnalyzer incremental;
+    std::vector<std::string> before = rendered(incremental.update(module));
+    CHECK(std::count(before.begin(), before.end(), division) == 1);
+
+    zero->initializer = integer(2, 1);
+    std::vector<std::string> after = rendered(incremental.update(module));
+    CHECK(incremental.last_rechecked() == 1);
+    CHECK(std::count(after.begin(), after.end(), division) == 0);
+    expect_modes_agree(module);
+}
+
+// Told which functions were edited, update() re-hashes only those bodies;
+// replaced nodes and signature edits are picked up regardless
+static void test_incremental_edit_hints() {
+    Module module = mixed_module();
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    IncrementalAnalyzer incremental(options);
+    incremental.update(module);
+
+    // An in-place body edit, reported
+    auto add = std::static_pointer_cast<FunctionNode>(module[1]);
+    add->body.push_back(declaration<LetDeclarationNode>("extra", nullptr, identifier("nowhere", 5), 5));
+    CHECK(rendered(incremental.update(module, {add.get()})) == serial(module, options));
+    CHECK(incremental.last_rechecked() == 1);
+
+    // Nothing reported: the cached result stands
+    CHECK(rendered(incremental.update(module, {})) == serial(module, options));
+    CHECK(incremental.last_rechecked() == 0);
+
+    // A replaced node is hashed without being reported
+    auto replacement = std::make_shared<FunctionNode>(*add);
+    replacement->body.pop_back();
+    module[1] = replacement;
+    CHECK(rendered(incremental.update(module, {})) == serial(module, options));
+    CHECK(incremental.last_rechecked() == 1);
+
+    // So is a signature edited in place, which re-checks the function and
+    // its callers
+    replacement->return_type = "bool";
+    CHECK(rendered(incremental.update(module, {})) == serial(module, options));
+    CHECK(incremental.last_rechecked() == 2);
+}
+
+// Float constants hold the value their declared type can represent
+static void test_f32_constant_rounding() {
+    auto real = [](double value) {
+        auto node = std::make_shared<FloatLiteralNode>(value);
+        node->line = 1;
+        return node;
+    };
+    SemanticAnalyzer analyzer;
+    analyzer.analyze(declaration<ConstDeclarationNode>("NARROW", "f32", binary("+", real(0.1), real(0.2), 1), 1));
+    analyzer.analyze(declaration<ConstDeclarationNode>("WIDE", "f64", binary("+", real(0.1), real(0.2), 2), 2));
+    const ConstantValue* narrow = analyzer.constant_value("NARROW");
+    const ConstantValue* wide = analyzer.constant_value("WIDE");
+    CHECK(narrow && narrow->kind == ConstantValue::Float && narrow->real == static_cast<float>(0.1 + 0.2));
+    CHECK(wide && wide->kind == ConstantValue::Float && wide->real == 0.1 + 0.2);
+}
+
+// Images without functions, or without any symbols, have empty sections
+static void test_symbol_image_empty_sections() {
+    const std::string path = "tests_symbols.tmp";
+    SemanticAnalyzer exporter;
+    exporter.analyze(declaration<ConstDeclarationNode>("ANSWER", "i32", integer(42, 1), 1));
+    exporter.export_symbols(path);
+
+    SymbolImage image(path);
+    CHECK(image.size() == 1);
+    SemanticAnalyzer importer;
+    importer.import_symbols(image);
+    const Symbol* answer = importer.resolve("ANSWER");
+    CHECK(answer && answer->symbol_type == SymbolType::Constant);
+
+    SemanticAnalyzer empty;
+    empty.export_symbols(path);
+    CHECK(SymbolImage(path).size() == 0);
+    std::remove(path.c_str());
+}
+
+// Overwrites node index of the AST image at from with patch and writes
+// the result to to
+static void patch_image_node(const std::string& from, const std::string& to, uint32_t index,
+                             void (*patch)(AstImage::Node&)) {
+    std::string bytes;
+    FILE* in = std::fopen(from.c_str(), "rb");
+    for (int c; (c = std::fgetc(in)) != EOF;) bytes += static_cast<char>(c);
+    std::fclose(in);
+
+    AstImage::Node node;
+    size_t offset = sizeof(AstImage::Header) + index * sizeof(AstImage::Node);
+    std::memcpy(&node, &bytes[offset], sizeof node);
+    patch(node);
+    std::memcpy(&bytes[offset], &node, sizeof node);
+
+    FILE* out = std::fopen(to.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size(), out);
+    std::fclose(out);
+}
+
+static bool image_rejected(const std::string& path) {
+    try {
+        AstImage image(path);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+// An image loads only if every node but the root has exactly one parent
+static void test_ast_image_ownership() {
+    // Breadth-first: 0 outer, 1 let x, 2 inner, 3 let y
+    auto outer = function("outer", "i32", 1);
+    parameter(*outer, "a", "i32");
+    outer->body.push_back(declaration<LetDeclarationNode>("x", "i32", integer(1, 2), 2));
+    auto inner = function("inner", "i32", 3);
+    parameter(*inner, "b", "i32");
+    inner->body.push_back(declaration<LetDeclarationNode>("y", "i32", identifier("b", 4), 4));
+    outer->body.push_back(inner);
+
+    const std::string path = "tests_ast.tmp", crafted = "tests_ast_crafted.tmp";
+    AstImage::write(path, outer);
+    {
+        AstImage image(path);
+        CHECK(image.size() == 4);
+        SemanticAnalyzer from_image, from_tree;
+        from_image.analyze(image);
+        from_tree.analyze(outer.get());
+        CHECK(rendered(from_image.diagnostics()) == rendered(from_tree.diagnostics()));
+    }
+
+    // outer also claims inner's body
+    patch_image_node(path, crafted, 0, [](AstImage::Node& n) { n.child_end = 4; });
+    CHECK(image_rejected(crafted));
+    // inner is left without a parent
+    patch_image_node(path, crafted, 0, [](AstImage::Node& n) { n.child_end = 2; });
+    CHECK(image_rejected(crafted));
+    // inner takes outer's parameter too
+    patch_image_node(path, crafted, 2, [](AstImage::Node& n) { n.param_begin = 0; });
+    CHECK(image_rejected(crafted));
+    // inner leaves its parameter unowned
+    patch_image_node(path, crafted, 2, [](AstImage::Node& n) { n.param_begin = n.param_end; });
+    CHECK(image_rejected(crafted));
+    // Unchanged, the copy loads
+    patch_image_node(path, crafted, 2, [](AstImage::Node&) {});
+    CHECK(!image_rejected(crafted));
+    std::remove(path.c_str());
+    std::remove(crafted.c_str());
+}
+
+// Pooled batch workers see what the batch's analyzer was given, and
+// imported constants fold
+static void test_pooled_batch_settings() {
+    const std::string path = "tests_symbols.tmp";
+    {
+        SemanticAnalyzer exporter;
+        exporter.begin_unit();
+        exporter.feed(declaration<ConstDeclarationNode>("ANSWER", "i32", integer(42, 1), 1));
+        auto helper = function("helper", "i32", 2);
+        parameter(*helper, "x", "i32");
+        exporter.feed(helper);
+        exporter.export_symbols(path);
+    }
+    SymbolImage image(path);
+
+    auto user = function("user", "i32", 1);
+    user->body.push_back(declaration<LetDeclarationNode>("v", "i32", call("helper", 1, 2), 2));
+    user->body.push_back(declaration<ConstDeclarationNode>("DOUBLE", "i32",
+                                                           binary("*", identifier("ANSWER", 3), integer(2, 3), 3), 3));
+    Module roots{user, user};
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    SemanticAnalyzer analyzer(options);
+    analyzer.import_symbols(image);
+    ThreadPool pool(2);
+    std::vector<std::vector<Diagnostic>> serial_batch = analyzer.analyze_batch(roots);
+    std::vector<std::vector<Diagnostic>> pooled_batch = analyzer.analyze_batch(roots, pool);
+    CHECK(serial_batch.size() == 2 && pooled_batch.size() == 2);
+    for (size_t i = 0; i < pooled_batch.size(); ++i) CHECK(rendered(pooled_batch[i]) == rendered(serial_batch[i]));
+    CHECK(std::none_of(pooled_batch[0].begin(), pooled_batch[0].end(), [](const Diagnostic& d) {
+        return d.code == DiagnosticCode::UndefinedName || d.code == DiagnosticCode::UndefinedFunction;
+    }));
+
+    SemanticAnalyzer folding(options);
+    folding.import_symbols(image);
+    folding.analyze(declaration<ConstDeclarationNode>("DOUBLE", "i32",
+                                                      binary("*", identifier("ANSWER", 1), integer(2, 1), 1), 1));
+    const ConstantValue* doubled = folding.constant_value("DOUBLE");
+    CHECK(doubled && doubled->kind == ConstantValue::Int && doubled->integer == 84);
+
+    analyzer.set_memory_budget(1);
+    bool over_budget = false;
+    try {
+        analyzer.analyze_batch(roots, pool);
+    } catch (const MemoryBudgetExceeded&) {
+        over_budget = true;
+    }
+    CHECK(over_budget);
+    analyzer.set_memory_budget(0);
+
+    CancellationToken token;
+    token.cancel();
+    analyzer.set_cancellation(token);
+    bool cancelled = false;
+    try {
+        analyzer.analyze_batch(roots, pool);
+    } catch (const AnalysisCancelled&) {
+        cancelled = true;
+    }
+    CHECK(cancelled);
+    std::remove(path.c_str());
+}
+
+static std::shared_ptr<ExpressionNode> unary(const std::string& op, std::shared_ptr<ExpressionNode> operand, int line) {
+    auto node = std::make_shared<UnaryExpressionNode>(op, std::move(operand));
+    node->line = line;
+    return node;
+}
+
+// Definitions, references and line queries over one function
+static void test_reference_index() {
+    auto func = function("main", "i32", 1);
+    parameter(*func, "a", "i32");
+    auto use_a = identifier("a", 2);
+    auto first_x = identifier("x", 3);
+    auto second_x = identifier("x", 4);
+    auto last_a = identifier("a", 4);
+    func->body.push_back(declaration<LetDeclarationNode>("x", "i32", use_a, 2));
+    func->body.push_back(declaration<LetDeclarationNode>("y", "i32", first_x, 3));
+    func->body.push_back(declaration<LetDeclarationNode>("z", "i32", binary("+", second_x, last_a, 4), 4));
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    SemanticAnalyzer analyzer(options);
+    analyzer.track_references(true);
+    analyzer.analyze(func.get());
+    const ReferenceIndex& refs = analyzer.references();
+
+    const Symbol* x = refs.definition(first_x.get());
+    CHECK(x && x->name == "x" && x->declaration_line == 2);
+    CHECK(refs.definition(second_x.get()) == x);
+    const Symbol* a = refs.definition(use_a.get());
+    CHECK(a && a->name == "a" && refs.definition(last_a.get()) == a);
+
+    std::vector<int> lines;
+    for (const auto& ref : refs.references(x)) lines.push_back(ref.line);
+    CHECK(lines == std::vector<int>({3, 4}));
+    CHECK(refs.at_line(4).size() == 2);
+    CHECK(refs.at_line(5).empty());
+
+    // Cleared with the unit, and not recorded unless asked for
+    analyzer.begin_unit();
+    CHECK(analyzer.references().size() == 0);
+    SemanticAnalyzer untracked(options);
+    untracked.analyze(func.get());
+    CHECK(untracked.references().size() == 0);
+}
+
+// Passes see each statement of their classes once, after its checks, with
+// the scopes as they stand there
+struct StatementCounter {
+    int functions = 0;
+    int lets = 0;
+    int resolved = 0;
+
+    void operator()(SemanticAnalyzer&, const FunctionNode*) { ++functions; }
+    void operator()(SemanticAnalyzer& analyzer, const LetDeclarationNode* let) {
+        ++lets;
+        if (analyzer.resolve(let->name)) ++resolved;
+    }
+};
+
+struct ConstCounter {
+    int consts = 0;
+
+    void operator()(SemanticAnalyzer&, const ConstDeclarationNode*) { ++consts; }
+};
+
+static void test_analyze_with() {
+    auto outer = function("outer", "i32", 1);
+    outer->body.push_back(declaration<LetDeclarationNode>("a", "i32", integer(1, 2), 2));
+    outer->body.push_back(declaration<ConstDeclarationNode>("K", "i32", integer(2, 3), 3));
+    auto inner = function("inner", "i32", 4);
+    inner->body.push_back(declaration<LetDeclarationNode>("b", "bool", integer(3, 5), 5));
+    outer->body.push_back(inner);
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    SemanticAnalyzer plain(options);
+    plain.analyze(outer.get());
+
+    StatementCounter statements;
+    ConstCounter consts;
+    SemanticAnalyzer with(options);
+    with.analyze_with(outer.get(), statements, consts);
+    CHECK(statements.functions == 2 && statements.lets == 2 && statements.resolved == 2);
+    CHECK(consts.consts == 1);
+    CHECK(rendered(with.diagnostics()) == rendered(plain.diagnostics()));
+
+    // Handlers are gone once analyze_with() returns
+    SemanticAnalyzer reused(options);
+    reused.analyze_with(outer.get(), statements);
+    reused.begin_unit();
+    reused.analyze(outer.get());
+    CHECK(statements.functions == 4 && statements.lets == 4);
+}
+
+// A pass that starts a flat or image walk is refused, and the analyzer
+// runs flat input normally afterwards
+struct NestedWalk {
+    const FlatAST* flat;
+    int refused = 0;
+
+    void operator()(SemanticAnalyzer& analyzer, const FunctionNode*) {
+        try {
+            analyzer.analyze(*flat);
+        } catch (const std::logic_error&) {
+            ++refused;
+        }
+    }
+};
+
+static void test_analyze_with_layouts() {
+    auto func = function("main", "i32", 1);
+    func->body.push_back(declaration<LetDeclarationNode>("x", "i32", identifier("missing", 2), 2));
+    FlatAST flat = FlatAST::from_tree(func);
+    const std::string path = "tests_passes_ast.tmp";
+    AstImage::write(path, func);
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    SemanticAnalyzer reference(options);
+    reference.analyze(flat);
+
+    NestedWalk nested{&flat};
+    SemanticAnalyzer analyzer(options);
+    analyzer.analyze_with(func.get(), nested);
+    CHECK(nested.refused == 1);
+
+    bool image_refused = false;
+    {
+        AstImage image(path);
+        struct ImageWalk {
+            const AstImage* image;
+            bool* refused;
+
+            void operator()(SemanticAnalyzer& analyzer, const LetDeclarationNode*) {
+                try {
+                    analyzer.analyze(*image);
+                } catch (const std::logic_error&) {
+                    *refused = true;
+                }
+            }
+        } walk{&image, &image_refused};
+        SemanticAnalyzer other(options);
+        other.analyze_with(func.get(), walk);
+    }
+    CHECK(image_refused);
+    std::remove(path.c_str());
+
+    analyzer.begin_unit();
+    analyzer.analyze(flat);
+    CHECK(rendered(analyzer.diagnostics()) == rendered(reference.diagnostics()));
+}
+
+// A PassManager sees the same declarations, balanced scopes and resolved
+// uses from the tree and the flat walk
+static void test_pass_manager() {
+    auto func = function("main", "i32", 1);
+    parameter(*func, "p", "i32");
+    func->body.push_back(declaration<LetDeclarationNode>("x", "i32", identifier("p", 2), 2));
+    func->body.push_back(declaration<LetDeclarationNode>("y", "i32", identifier("nowhere", 3), 3));
+
+    auto events = [&](bool flat_walk) {
+        std::vector<std::string> seen;
+        int depth = 0;
+        bool balanced = true;
+        PassManager manager;
+        manager.on_declaration([&](const Symbol& symbol, size_t at) {
+            seen.push_back("declare " + std::string(symbol.name) + " " + std::to_string(at));
+        });
+        manager.on_scope_enter([&](size_t) { ++depth; });
+        manager.on_scope_exit([&](size_t) { balanced = balanced && depth-- > 0; });
+        manager.on_use([&](const Symbol& symbol, const void*, int line) {
+            seen.push_back("use " + std::string(symbol.name) + " " + std::to_string(line));
+        });
+
+        DiagnosticOptions options;
+        options.throw_on_error = false;
+        SemanticAnalyzer analyzer(options);
+        analyzer.use_passes(&manager);
+        FlatAST flat = FlatAST::from_tree(func);
+        if (flat_walk) analyzer.analyze(flat); else analyzer.analyze(func.get());
+        CHECK(balanced && depth == 0);
+        return seen;
+    };
+    std::vector<std::string> tree = events(false);
+    CHECK(std::count(tree.begin(), tree.end(), "use p 2") == 1);
+    CHECK(std::none_of(tree.begin(), tree.end(), [](const std::string& e) { return e.find("nowhere") != std::string::npos; }));
+    CHECK(std::count_if(tree.begin(), tree.end(), [](const std::string& e) { return e.rfind("declare ", 0) == 0; }) == 4);
+    CHECK(events(true) == tree);
+}
+
+// Images round-trip through a file and analyze like the tree; damaged
+// files are refused
+static void test_ast_image_round_trip() {
+    auto func = function("main", "i32", 1);
+    parameter(*func, "n", "i64");
+    func->body.push_back(declaration<LetDeclarationNode>("flag", "bool", integer(1, 2), 2));
+    func->body.push_back(declaration<LetDeclarationNode>("sum", nullptr, binary("+", identifier("n", 3), integer(2, 3), 3), 3));
+    func->body.push_back(declaration<LetDeclarationNode>("r", nullptr, call("main", 2, 4), 4));
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    SemanticAnalyzer from_tree(options);
+    from_tree.analyze(func.get());
+    CHECK(!from_tree.diagnostics().empty());
+
+    const std::string path = "tests_ast.tmp", damaged = "tests_ast_damaged.tmp";
+    AstImage::write(path, func);
+    {
+        AstImage image(path);
+        CHECK(image.size() == 4);
+        SemanticAnalyzer from_image(options);
+        from_image.analyze(image);
+        CHECK(rendered(from_image.diagnostics()) == rendered(from_tree.diagnostics()));
+    }
+
+    std::string bytes;
+    FILE* in = std::fopen(path.c_str(), "rb");
+    for (int c; (c = std::fgetc(in)) != EOF;) bytes += static_cast<char>(c);
+    std::fclose(in);
+    auto write_damaged = [&](const std::string& contents) {
+        FILE* out = std::fopen(damaged.c_str(), "wb");
+        std::fwrite(contents.data(), 1, contents.size(), out);
+        std::fclose(out);
+    };
+    write_damaged(bytes.substr(0, bytes.size() - 1));
+    CHECK(image_rejected(damaged));
+    write_damaged("XAST" + bytes.substr(4));
+    CHECK(image_rejected(damaged));
+    CHECK(image_rejected("tests_no_such_image.tmp"));
+    std::remove(path.c_str());
+    std::remove(damaged.c_str());
+}
+
+// A cancelled token stops async runs between top-level nodes and plain
+// walks at their next check
+static void test_cancellation() {
+    Module module = mixed_module();
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+
+    CancellationToken early;
+    early.cancel();
+    SemanticAnalyzer before_start(options);
+    SemanticAnalyzer::AsyncResult none = before_start.analyze_async(module, early).get();
+    CHECK(none.cancelled && none.completed == 0 && none.diagnostics.empty());
+
+    // Cancelled from the partial result of the second node
+    CancellationToken token;
+    std::vector<size_t> partials;
+    SemanticAnalyzer midway(options);
+    SemanticAnalyzer::AsyncResult some = midway.analyze_async(module, token, [&](size_t index, const std::vector<Diagnostic>&) {
+        partials.push_back(index);
+        if (index == 1) token.cancel();
+    }).get();
+    CHECK(some.cancelled && some.completed == 2);
+    CHECK(partials == std::vector<size_t>({0, 1}));
+
+    // Usable again once the run is over
+    SemanticAnalyzer::AsyncResult all = midway.analyze_async(module, CancellationToken()).get();
+    CHECK(!all.cancelled && all.completed == module.size());
+    CHECK(rendered(all.diagnostics) == serial(module, options));
+
+    SemanticAnalyzer walk(options);
+    walk.set_cancellation(early);
+    bool stopped = false;
+    try {
+        walk.analyze(module[2].get());
+    } catch (const AnalysisCancelled&) {
+        stopped = true;
+    }
+    CHECK(stopped);
+    walk.clear_cancellation();
+    walk.begin_unit();
+    walk.analyze(module[2].get());
+}
+
+// The portable definition of NameKernel::hash. Symbol images key their
+// slots by it, so every SIMD path has to agree with it bit for bit.
+static uint64_t reference_name_hash(std::string_view name) {
+    static const uint64_t seed[4] = {0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull,
+                                     0x082EFA98EC4E6C89ull};
+    static const uint64_t secret[4] = {0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull,
+                                       0x3F84D5B5B5470917ull};
+    uint64_t acc[4] = {seed[0], seed[1], seed[2], seed[3]};
+    auto stripe = [&](const char* p) {
+        uint64_t d[4];
+        std::memcpy(d, p, sizeof d);
+        for (size_t i = 0; i < 4; ++i) {
+            uint64_t k = d[i] ^ secret[i];
+            acc[i] += (k & 0xFFFFFFFFu) * (k >> 32) + d[i ^ 1];
+        }
+    };
+    size_t n = name.size();
+    if (n < 32) {
+        char padded[32] = {};
+        if (n) std::memcpy(padded, name.data(), n);
+        stripe(padded);
+    } else {
+        for (size_t i = 0; i + 32 < n; i += 32) stripe(name.data() + i);
+        stripe(name.data() + n - 32);
+    }
+
+    uint64_t h = n * 0x9E3779B97F4A7C15ull;
+    for (uint64_t a : acc) {
+        h ^= a;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static void test_name_kernel() {
+    // Odd offsets, so that loads are unaligned
+    std::string text(300, '\0');
+    uint32_t state = 12345;
+    for (char& c : text) {
+        state = state * 1103515245u + 12345u;
+        c = static_cast<char>(state >> 16);
+    }
+    for (size_t n = 0; n <= 130; ++n) {
+        std::string_view name(text.data() + 1 + n % 7, n);
+        CHECK(NameKernel::hash(name) == reference_name_hash(name));
+    }
+
+    // equal() agrees with == wherever the names differ, or when they don't
+    for (size_t n = 0; n <= 80; ++n) {
+        std::string a = text.substr(3, n), b = a;
+        CHECK(NameKernel::equal(a, b));
+        for (size_t i = 0; i < n; ++i) {
+            b[i] ^= 0x20;
+            CHECK(!NameKernel::equal(a, b));
+            b[i] ^= 0x20;
+        }
+        CHECK(!NameKernel::equal(a, a + "x"));
+    }
+}
+
+// Integer constants fold at their declared width; out-of-range results,
+// overflow and division by zero are reported and leave no value
+static void test_integer_folding() {
+    Module module;
+    module.push_back(declaration<ConstDeclarationNode>("A", "i32", binary("+", integer(2, 1), binary("*", integer(3, 1), integer(4, 1), 1), 1), 1));
+    module.push_back(declaration<ConstDeclarationNode>("B", "i32", unary("-", binary("/", identifier("A", 2), integer(4, 2), 2), 2), 2));
+    module.push_back(declaration<ConstDeclarationNode>("C", "u8", binary("%", integer(255, 3), integer(7, 3), 3), 3));
+    module.push_back(declaration<ConstDeclarationNode>("D", "i64", binary("<<", integer(1, 4), integer(40, 4), 4), 4));
+    module.push_back(declaration<ConstDeclarationNode>("WIDE", "u8", binary("+", integer(255, 5), integer(1, 5), 5), 5));
+    module.push_back(declaration<ConstDeclarationNode>("ZERO", "i32", binary("/", identifier("A", 6), integer(0, 6), 6), 6));
+    module.push_back(declaration<ConstDeclarationNode>("SHIFT", "i32", binary("<<", integer(1, 7), integer(40, 7), 7), 7));
+    module.push_back(declaration<ConstDeclarationNode>("FULL", "i32", binary("<<", identifier("A", 8), integer(32, 8), 8), 8));
+
+    DiagnosticOptions options;
+    options.throw_on_error = false;
+    SemanticAnalyzer analyzer(options);
+    analyzer.begin_unit();
+    for (const auto& node : module) analyzer.feed(node);
+    auto value = [&](const char* name) {
+        const ConstantValue* v = analyzer.constant_value(name);
+        return v && v->kind == ConstantValue::Int ? v->integer : INT64_MIN;
+    };
+    CHECK(value("A") == 14);
+    CHECK(value("B") == -3);
+    CHECK(value("C") == 3);
+    CHECK(value("D") == int64_t(1) << 40);
+    CHECK(!analyzer.constant_value("WIDE"));
+    CHECK(!analyzer.constant_value("ZERO"));
+    CHECK(!analyzer.constant_value("SHIFT"));
+    CHECK(!analyzer.constant_value("FULL"));
+
+    std::vector<Diagnostic> diagnostics = analyzer.end_unit();
+    auto reported = [&](int line, DiagnosticCode code) {
+        return std::any_of(diagnostics.begin(), diagnostics.end(),
+                           [&](const Diagnostic& d) { return d.line == line && d.code == code; });
+    };
+    CHECK(reported(5, DiagnosticCode::ConstantOutOfRange) || reported(5, DiagnosticCode::ConstantOverflow));
+    CHECK(reported(6, DiagnosticCode::DivisionByZero));
+    CHECK(reported(7, DiagnosticCode::ConstantOutOfRange) || reported(7, DiagnosticCode::ConstantOverflow));
+    CHECK(reported(8, DiagnosticCode::ConstantOverflow));
+    CHECK(std::none_of(diagnostics.begin(), diagnostics.end(), [](const Diagnostic& d) {
+        return d.severity == Severity::Error && d.line <= 4;
+    }));
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const TestCase kTests[] = {
+    {"modes_agree", test_modes_agree},
+    {"module_analysis", test_module_analysis},
+    {"unknown_types_reported_once", test_unknown_types_reported_once},
+    {"error_limit_counts_errors", test_error_limit_counts_errors},
+    {"shared_subtree_scopes", test_shared_subtree_scopes},
+    {"expression_types_reset", test_expression_types_reset},
+    {"aborted_unit", test_aborted_unit},
+    {"memory_budget_per_unit", test_memory_budget_per_unit},
+    {"deep_input", test_deep_input},
+    {"incremental_invalidation", test_incremental_invalidation},
+    {"incremental_constant_value", test_incremental_constant_value},
+    {"incremental_edit_hints", test_incremental_edit_hints},
+    {"f32_constant_rounding", test_f32_constant_rounding},
+    {"symbol_image_empty_sections", test_symbol_image_empty_sections},
+    {"ast_image_ownership", test_ast_image_ownership},
+    {"pooled_batch_settings", test_pooled_batch_settings},
+    {"reference_index", test_reference_index},
+    {"analyze_with", test_analyze_with},
+    {"analyze_with_layouts", test_analyze_with_layouts},
+    {"pass_manager", test_pass_manager},
+    {"ast_image_round_trip", test_ast_image_round_trip},
+    {"cancellation", test_cancellation},
+    {"name_kernel", test_name_kernel},
+    {"integer_folding", test_integer_folding},
+};
+
+int main(int argc, char** argv) {
+    for (const auto& test : kTests) {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc; ++i) wanted = wanted || !std::strcmp(argv[i], test.name);
+        if (!wanted) continue;
+        int before = g_failures;
+        std::printf("%s\n", test.name);
+        test.run();
+        if (g_failures != before) std::printf("  FAILED\n");
+    }
+    std::printf("%d check%s failed\n", g_failures, g_failures == 1 ? "" : "s");
+    return g_failures ? 1 : 0;
+}